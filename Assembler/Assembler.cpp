@@ -8,7 +8,7 @@
 
 using namespace std;
 
-Assembler::Assembler(const string &filename): filename(filename) {
+Assembler::Assembler(const string &filename, const PeepholeRules* rules): filename(filename), outputFilename(filename.substr(0, filename.length() - 3) + "hack") {
 	cout << "Trying to open filename " << this->filename << endl;
 	assemblyFile.open(filename);
 
@@ -18,7 +18,20 @@ Assembler::Assembler(const string &filename): filename(filename) {
 	}
 
 	auto start = chrono::high_resolution_clock::now();
-	getLoopAddresses();
+	if (rules) {
+		stringstream contents;
+		contents << assemblyFile.rdbuf();
+		int numRewrites = 0;
+		istringstream rewritten(rules->apply(contents.str(), numRewrites));
+		auto stop = chrono::high_resolution_clock::now();
+		auto duration = chrono::duration_cast<chrono::milliseconds>(stop - start);
+		cout << "Applied " << rules->size() << " peephole rules at " << numRewrites << " places in " << duration.count() << "ms." << endl;
+		start = chrono::high_resolution_clock::now();
+		getLoopAddresses(rewritten);
+	}
+	else {
+		getLoopAddresses(assemblyFile);
+	}
 	auto stop = chrono::high_resolution_clock::now();
 	auto duration = chrono::duration_cast<chrono::milliseconds>(stop - start);
 	cout << "Got loop addresses in " << duration.count() << "ms." << endl;
@@ -30,10 +43,10 @@ Assembler::Assembler(const string &filename): filename(filename) {
 	cout << "Converted commands in " << duration.count() << "ms." << endl;
 }
 
-void Assembler::getLoopAddresses() {
+void Assembler::getLoopAddresses(istream& input) {
 	string line;
 	int instructionNum = 0;
-	while (getline(assemblyFile, line)) {
+	while (getline(input, line)) {
 		removeComments(line);
 		if (line.length() == 0) continue;
 		if (line.at(0) == '(') {
@@ -50,11 +63,10 @@ void Assembler::getLoopAddresses() {
 void Assembler::convertCommands() {
 	codeNoCommentsLabels.seekg(0);
 
-	string newFilename = filename.substr(0, filename.length() - 3) + "hack";
-	cout << "Printing to filename " << newFilename << endl;
+	cout << "Printing to filename " << outputFilename << endl;
 
 	string line;
-	binaryFile.open(newFilename);
+	binaryFile.open(outputFilename);
 	while (getline(codeNoCommentsLabels, line)) {
 		if (line.at(0) == '@') {
 			convertACommand(line);
@@ -175,13 +187,19 @@ const std::map <std::string_view, std::string> Assembler::compMap = {
 		{ "A-1", "0110010" },
 		{ "M-1", "1110010" },
 		{ "D+A", "0000010" },
+		{ "A+D", "0000010" },
 		{ "D+M", "1000010" },
+		{ "M+D", "1000010" },
 		{ "D-A", "0010011" },
 		{ "D-M", "1010011" },
 		{ "A-D", "0000111" },
 		{ "M-D", "1000111" },
 		{ "D&A", "0000000" },
+		{ "A&D", "0000000" },
 		{ "D&M", "1000000" },
+		{ "M&D", "1000000" },
 		{ "D|A", "0010101" },
-		{ "D|M", "1010101" }
+		{ "A|D", "0010101" },
+		{ "D|M", "1010101" },
+		{ "M|D", "1010101" }
 };
\ No newline at end of file
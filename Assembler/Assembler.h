@@ -4,14 +4,17 @@
 #include <map>
 #include <fstream>
 #include <sstream>
+#include <string_view>
+#include "../VM translator/PeepholeRules.h"
 constexpr int FIRST_FREE_MEM = 16;
 
 class Assembler
 {
 public:
-	Assembler(const std::string& filename);
+	// With rules, the superoptimizer's peephole rewrites are applied before assembling
+	Assembler(const std::string& filename, const PeepholeRules* rules = nullptr);
 
-	void getLoopAddresses();
+	void getLoopAddresses(std::istream& input);
 	void removeComments(std::string& line);
 	void convertCommands();
 	void convertACommand(std::string& command);
@@ -21,6 +24,7 @@ public:
 
 private:
 	const std::string filename;
+	const std::string outputFilename;
 	std::stringstream codeNoCommentsLabels;
 	std::ofstream binaryFile;
 	std::ifstream assemblyFile;
@@ -2,24 +2,41 @@
 //
 
 #include "Assembler.h"
+#include "../VM translator/PeepholeRules.h"
 #include <iostream>
 #include <string>
+#include <memory>
 
 using namespace std;
 
 int main(int argc, char** argv)
 {
     string filename;
+    string rulesName; // -rules: peephole rules from the superoptimizer
 
-    if (argc <= 1) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "-rules" && i + 1 < argc) {
+            rulesName = argv[++i];
+        }
+        else {
+            filename = arg;
+        }
+    }
+    if (filename.empty()) {
         cout << "Enter filename: ";
         cin >> filename;
     }
-    else {
-        filename = argv[1];
+
+    unique_ptr<PeepholeRules> rules;
+    if (!rulesName.empty()) {
+        rules = make_unique<PeepholeRules>(rulesName);
+        if (rules->didFailOpen()) {
+            return -1;
+        }
     }
 
-    Assembler assembler(filename);
+    Assembler assembler(filename, rules.get());
 
     return 0;
 }
@@ -0,0 +1,3 @@
+#!/bin/bash
+# The peephole rules are the VM translator's, shared rather than copied
+g++ -std=c++2a -O2 *.cpp "../VM translator/PeepholeRules.cpp" -o HackAssembler.o
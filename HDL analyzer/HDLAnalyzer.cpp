@@ -0,0 +1,79 @@
+// HDLAnalyzer.cpp : Flattens a chip down to Nand gates and DFFs and reports its hardware cost as JSON.
+//
+
+#include "HDLParser.h"
+#include "Netlist.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    string chipFile;
+    string outputName;
+    int topN = 10;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            outputName = argv[++i];
+        }
+        else if (arg == "-top" && i + 1 < argc) {
+            try {
+                topN = max(0, stoi(argv[++i]));
+            }
+            catch (const logic_error&) { // invalid_argument or out_of_range
+                cerr << "-top needs a number of nets, not \"" << argv[i] << "\". Closing..." << endl;
+                return -1;
+            }
+        }
+        else {
+            chipFile = arg;
+        }
+    }
+    if (chipFile.empty()) {
+        std::cout << "Enter .hdl filename: ";
+        std::cin >> chipFile;
+        std::cout << endl;
+    }
+
+    auto start = chrono::high_resolution_clock::now();
+    filesystem::path chipPath(chipFile);
+    if (chipPath.extension() != ".hdl") chipPath += ".hdl";
+    string directory = chipPath.has_parent_path() ? chipPath.parent_path().string() : ".";
+
+    // Progress goes to stderr so the JSON report can be piped
+    ChipLibrary library(directory);
+    Netlist netlist(library);
+    if (!netlist.build(chipPath.stem().string())) {
+        cerr << "Unable to flatten " << chipPath.string() << ". Closing..." << endl;
+        return -1;
+    }
+
+    NetlistAnalyzer analyzer(netlist);
+    if (analyzer.hasCombinationalLoop()) {
+        cerr << "Warning: " << chipPath.stem().string() << " contains a combinational loop, depths of gates on the loop are not reported." << endl;
+    }
+
+    if (outputName.empty()) {
+        analyzer.writeJson(std::cout, topN);
+    }
+    else {
+        ofstream outputFile(outputName);
+        if (!outputFile.is_open()) {
+            cerr << "Error opening file " << outputName << " for output." << endl;
+            return -1;
+        }
+        analyzer.writeJson(outputFile, topN);
+    }
+
+    auto stop = chrono::high_resolution_clock::now();
+    auto duration = chrono::duration_cast<chrono::milliseconds>(stop - start);
+    cerr << "Analyzed " << netlist.gates.size() << " gates in " << duration.count() << "ms." << endl;
+}
@@ -0,0 +1,309 @@
+#include "HDLParser.h"
+#include <iostream>
+#include <sstream>
+#include <filesystem>
+#include <cctype>
+
+using namespace std;
+
+static const char* brightError = "\x1B[91mERROR\033[0m";
+
+// Chips that have no HDL implementation in the project but are referenced by it.
+// ARegister and DRegister behave exactly like Register; the rest stay opaque.
+static const map<string, string> builtinAliases = {
+	{ "ARegister", "Register" },
+	{ "DRegister", "Register" }
+};
+
+static const map<string, ChipDef> builtinChips = {
+	{ "Nand",     { "Nand",     { { "a", 1 }, { "b", 1 } }, { { "out", 1 } }, {}, true, false } },
+	{ "DFF",      { "DFF",      { { "in", 1 } }, { { "out", 1 } }, {}, true, false } },
+	{ "ROM32K",   { "ROM32K",   { { "address", 15 } }, { { "out", 16 } }, {}, false, true } },
+	{ "Screen",   { "Screen",   { { "in", 16 }, { "load", 1 }, { "address", 13 } }, { { "out", 16 } }, {}, false, true } },
+	{ "Keyboard", { "Keyboard", {}, { { "out", 16 } }, {}, false, true } }
+};
+
+const PinDecl* ChipDef::findInput(const string& pin) const
+{
+	for (auto& decl : inputs) {
+		if (decl.name == pin) return &decl;
+	}
+	return nullptr;
+}
+
+const PinDecl* ChipDef::findOutput(const string& pin) const
+{
+	for (auto& decl : outputs) {
+		if (decl.name == pin) return &decl;
+	}
+	return nullptr;
+}
+
+HDLParser::HDLParser(const string& filename): filename(filename)
+{
+	ifstream hdlFile(filename);
+	if (!hdlFile.is_open()) {
+		failedOpen = true;
+		return;
+	}
+	stringstream buffer;
+	buffer << hdlFile.rdbuf();
+	source = buffer.str();
+	advance();
+}
+
+bool HDLParser::didFailOpen()
+{
+	return failedOpen;
+}
+
+void HDLParser::error(const string& message)
+{
+	if (!syntaxError) {
+		cout << brightError << " in " << filename << " at line " << curr.line << ": " << message << endl;
+	}
+	syntaxError = true;
+}
+
+void HDLParser::skipWhitespaceAndComments()
+{
+	while (pos < source.length()) {
+		if (source[pos] == '\n') {
+			++lineNum;
+			++pos;
+		}
+		else if (isspace(static_cast<unsigned char>(source[pos]))) {
+			++pos;
+		}
+		else if (source.compare(pos, 2, "//") == 0) {
+			while (pos < source.length() && source[pos] != '\n') ++pos;
+		}
+		else if (source.compare(pos, 2, "/*") == 0) { // covers doc comments as well (/**)
+			pos += 2;
+			while (pos < source.length() && source.compare(pos, 2, "*/") != 0) {
+				if (source[pos] == '\n') ++lineNum;
+				++pos;
+			}
+			pos += 2;
+		}
+		else return;
+	}
+}
+
+void HDLParser::advance()
+{
+	skipWhitespaceAndComments();
+	curr.line = lineNum;
+	curr.text.clear();
+	if (pos >= source.length()) {
+		curr.type = Tok::END;
+		return;
+	}
+
+	char c = source[pos];
+	if (isalpha(static_cast<unsigned char>(c)) || c == '_') {
+		curr.type = Tok::IDENT;
+		while (pos < source.length() && (isalnum(static_cast<unsigned char>(source[pos])) || source[pos] == '_')) {
+			curr.text += source[pos++];
+		}
+	}
+	else if (isdigit(static_cast<unsigned char>(c))) {
+		curr.type = Tok::NUMBER;
+		while (pos < source.length() && isdigit(static_cast<unsigned char>(source[pos]))) {
+			curr.text += source[pos++];
+		}
+	}
+	else {
+		curr.type = Tok::SYMBOL;
+		if (source.compare(pos, 2, "..") == 0) {
+			curr.text = "..";
+			pos += 2;
+		}
+		else {
+			curr.text = c;
+			++pos;
+		}
+	}
+}
+
+bool HDLParser::eat(const char* symbol)
+{
+	if (curr.type == Tok::SYMBOL && curr.text == symbol) {
+		advance();
+		return true;
+	}
+	return false;
+}
+
+bool HDLParser::expect(const char* symbol)
+{
+	if (eat(symbol)) return true;
+	error(string("Expected '") + symbol + "' and got '" + curr.text + "' instead.");
+	return false;
+}
+
+bool HDLParser::expectIdentifier(string& out)
+{
+	if (curr.type != Tok::IDENT) {
+		error("Expected identifier and got '" + curr.text + "' instead.");
+		return false;
+	}
+	out = curr.text;
+	advance();
+	return true;
+}
+
+bool HDLParser::expectNumber(int& out)
+{
+	if (curr.type != Tok::NUMBER) {
+		error("Expected number and got '" + curr.text + "' instead.");
+		return false;
+	}
+	out = stoi(curr.text);
+	advance();
+	return true;
+}
+
+bool HDLParser::parsePinList(vector<PinDecl>& pins)
+{
+	do {
+		PinDecl pin;
+		if (!expectIdentifier(pin.name)) return false;
+		if (eat("[")) {
+			if (!expectNumber(pin.width) || !expect("]")) return false;
+		}
+		pins.push_back(pin);
+	} while (eat(","));
+	return expect(";");
+}
+
+bool HDLParser::parseBusRef(BusRef& ref)
+{
+	if (!expectIdentifier(ref.name)) return false;
+	if (eat("[")) {
+		ref.hasRange = true;
+		if (!expectNumber(ref.lo)) return false;
+		ref.hi = ref.lo;
+		if (eat("..")) {
+			if (!expectNumber(ref.hi)) return false;
+		}
+		if (!expect("]")) return false;
+		if (ref.hi < ref.lo) {
+			error("Sub-bus " + ref.name + "[" + to_string(ref.lo) + ".." + to_string(ref.hi) + "] is reversed.");
+			return false;
+		}
+	}
+	return true;
+}
+
+bool HDLParser::parsePart(Part& part)
+{
+	part.line = curr.line;
+	if (!expectIdentifier(part.chipName) || !expect("(")) return false;
+	do {
+		Connection conn;
+		if (!parseBusRef(conn.inner) || !expect("=") || !parseBusRef(conn.outer)) return false;
+		part.connections.push_back(conn);
+	} while (eat(","));
+	return expect(")") && expect(";");
+}
+
+bool HDLParser::parse(ChipDef& chip)
+{
+	if (failedOpen) return false;
+	if (curr.type != Tok::IDENT || curr.text != "CHIP") {
+		error("File does not begin with CHIP declaration.");
+		return false;
+	}
+	advance();
+	if (!expectIdentifier(chip.name) || !expect("{")) return false;
+
+	while (curr.type == Tok::IDENT && (curr.text == "IN" || curr.text == "OUT")) {
+		bool isInput = curr.text == "IN";
+		advance();
+		if (!parsePinList(isInput ? chip.inputs : chip.outputs)) return false;
+	}
+
+	if (curr.type == Tok::IDENT && curr.text == "BUILTIN") {
+		error("BUILTIN chips are not supported, only chips implemented with PARTS.");
+		return false;
+	}
+	if (curr.type != Tok::IDENT || curr.text != "PARTS") {
+		error("Expected PARTS and got '" + curr.text + "' instead.");
+		return false;
+	}
+	advance();
+	if (!expect(":")) return false;
+
+	while (curr.type == Tok::IDENT) {
+		Part part;
+		if (!parsePart(part)) return false;
+		chip.parts.push_back(part);
+	}
+	return expect("}");
+}
+
+HDLParser::~HDLParser()
+{
+}
+
+ChipLibrary::ChipLibrary(const string& directory): directory(directory)
+{
+}
+
+bool ChipLibrary::failed()
+{
+	return loadFailed;
+}
+
+bool ChipLibrary::addBuiltin(const string& chipName)
+{
+	auto builtinIt = builtinChips.find(chipName);
+	if (builtinIt != builtinChips.end()) {
+		chips.emplace(chipName, builtinIt->second);
+		return true;
+	}
+	auto aliasIt = builtinAliases.find(chipName);
+	if (aliasIt != builtinAliases.end()) {
+		const ChipDef* target = get(aliasIt->second);
+		if (target == nullptr) return false;
+		ChipDef alias = *target;
+		alias.name = chipName;
+		chips.emplace(chipName, alias);
+		return true;
+	}
+	return false;
+}
+
+const ChipDef* ChipLibrary::get(const string& chipName)
+{
+	auto chipIt = chips.find(chipName);
+	if (chipIt != chips.end()) {
+		return &chipIt->second;
+	}
+
+	// Prefer the project's own implementation over a built-in model when there is one
+	filesystem::path hdlPath = filesystem::path(directory) / (chipName + ".hdl");
+	if (filesystem::exists(hdlPath)) {
+		HDLParser parser(hdlPath.string());
+		ChipDef chip;
+		if (!parser.parse(chip)) {
+			loadFailed = true;
+			return nullptr;
+		}
+		if (chip.name != chipName) {
+			cout << brightError << ": " << hdlPath.string() << " defines chip " << chip.name << " instead of " << chipName << endl;
+			loadFailed = true;
+			return nullptr;
+		}
+		return &chips.emplace(chipName, chip).first->second;
+	}
+
+	if (addBuiltin(chipName)) {
+		return &chips.at(chipName);
+	}
+
+	cout << brightError << ": Unable to find chip " << chipName << " (looked for " << hdlPath.string() << ")" << endl;
+	loadFailed = true;
+	return nullptr;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+
+struct PinDecl {
+	std::string name;
+	int width = 1;
+};
+
+// One side of a connection, e.g. "out[0..7]", "sel" or "true"
+struct BusRef {
+	std::string name;
+	int lo = 0;
+	int hi = 0;
+	bool hasRange = false;
+	bool isConstant() const { return name == "true" || name == "false"; }
+};
+
+struct Connection {
+	BusRef inner; // pin of the part
+	BusRef outer; // pin, internal bus or constant of the enclosing chip
+};
+
+struct Part {
+	std::string chipName;
+	std::vector<Connection> connections;
+	int line = 0;
+};
+
+struct ChipDef {
+	std::string name;
+	std::vector<PinDecl> inputs;
+	std::vector<PinDecl> outputs;
+	std::vector<Part> parts;
+	bool isPrimitive = false; // Nand and DFF, evaluated directly by the netlist
+	bool isBlackBox = false;  // built-in chip without an HDL implementation (ROM32K, Screen, Keyboard)
+
+	const PinDecl* findInput(const std::string& pin) const;
+	const PinDecl* findOutput(const std::string& pin) const;
+};
+
+class HDLParser
+{
+public:
+	HDLParser(const std::string& filename);
+	bool didFailOpen();
+	bool parse(ChipDef& chip); // returns false on syntax error
+	~HDLParser();
+
+private:
+	enum class Tok { IDENT, NUMBER, SYMBOL, END };
+	struct Token {
+		Tok type = Tok::END;
+		std::string text;
+		int line = 0;
+	};
+
+	std::string filename;
+	std::string source;
+	size_t pos = 0;
+	int lineNum = 1;
+	bool failedOpen = false;
+	bool syntaxError = false;
+	Token curr;
+
+	void advance();
+	void skipWhitespaceAndComments();
+	bool eat(const char* symbol);
+	bool expect(const char* symbol);
+	bool expectIdentifier(std::string& out);
+	bool expectNumber(int& out);
+	bool parsePinList(std::vector<PinDecl>& pins);
+	bool parseBusRef(BusRef& ref);
+	bool parsePart(Part& part);
+	void error(const std::string& message);
+};
+
+// Loads chip definitions by name from a single directory, caching each one
+class ChipLibrary
+{
+public:
+	ChipLibrary(const std::string& directory);
+	const ChipDef* get(const std::string& chipName);
+	bool failed();
+
+private:
+	std::string directory;
+	std::map<std::string, ChipDef> chips;
+	bool loadFailed = false;
+	bool addBuiltin(const std::string& chipName);
+};
@@ -0,0 +1,464 @@
+#include "Netlist.h"
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+
+using namespace std;
+
+static const char* brightError = "\x1B[91mERROR\033[0m";
+constexpr int MAX_NESTING = 64; // deeper than any real chip, catches chips that contain themselves
+
+Netlist::Netlist(ChipLibrary& library): library(library)
+{
+}
+
+const ChipDef* Netlist::top() const
+{
+	return topDef;
+}
+
+int Netlist::newNet()
+{
+	netParent.push_back(static_cast<int>(netParent.size()));
+	return static_cast<int>(netParent.size()) - 1;
+}
+
+int Netlist::find(int net)
+{
+	while (netParent[net] != net) {
+		netParent[net] = netParent[netParent[net]]; // path halving
+		net = netParent[net];
+	}
+	return net;
+}
+
+void Netlist::merge(int a, int b)
+{
+	a = find(a);
+	b = find(b);
+	if (a != b) netParent[b] = a;
+}
+
+void Netlist::error(int instance, const string& message)
+{
+	cout << brightError << " in " << instancePath(instance) << ": " << message << endl;
+	failed = true;
+}
+
+string Netlist::instancePath(int instance) const
+{
+	vector<string> labels;
+	while (instance >= 0) {
+		const Instance& inst = instances[instance];
+		if (inst.parent < 0) labels.push_back(inst.chip->name);
+		else labels.push_back(inst.chip->name + "#" + to_string(inst.partIdx));
+		instance = inst.parent;
+	}
+	string path;
+	for (auto it = labels.rbegin(); it != labels.rend(); ++it) {
+		if (!path.empty()) path += "/";
+		path += *it;
+	}
+	return path;
+}
+
+string Netlist::netName(int net) const
+{
+	if (net >= 0 && net < static_cast<int>(netNames.size())) return netNames[net];
+	return "";
+}
+
+static int totalWidth(const vector<PinDecl>& pins)
+{
+	return accumulate(pins.begin(), pins.end(), 0, [](int sum, const PinDecl& pin) { return sum + pin.width; });
+}
+
+bool Netlist::build(const string& topChip)
+{
+	topDef = library.get(topChip);
+	if (topDef == nullptr) return false;
+
+	falseNet = newNet();
+	trueNet = newNet();
+
+	vector<int> inputNets, outputNets;
+	for (auto& pin : topDef->inputs) {
+		for (int bit = 0; bit < pin.width; ++bit) {
+			topInputs[pin.name].push_back(newNet());
+			inputNets.push_back(topInputs[pin.name].back());
+		}
+	}
+	for (auto& pin : topDef->outputs) {
+		for (int bit = 0; bit < pin.width; ++bit) {
+			topOutputs[pin.name].push_back(newNet());
+			outputNets.push_back(topOutputs[pin.name].back());
+		}
+	}
+
+	instances.push_back({ -1, topDef, 0 });
+	if (!instantiate(*topDef, inputNets, outputNets, 0, 0) || failed) return false;
+
+	// Collapse merged nets so every wire bit has exactly one id
+	for (auto& gate : gates) {
+		for (auto& in : gate.in) {
+			if (in >= 0) in = find(in);
+		}
+		if (gate.out >= 0) gate.out = find(gate.out);
+	}
+	for (auto* pins : { &topInputs, &topOutputs }) {
+		for (auto& [name, nets] : *pins) {
+			for (auto& net : nets) net = find(net);
+		}
+	}
+	falseNet = find(falseNet);
+	trueNet = find(trueNet);
+	numNets = static_cast<int>(netParent.size());
+
+	netNames.assign(numNets, "");
+	netNames[falseNet] = "false";
+	netNames[trueNet] = "true";
+	for (auto& [name, nets] : topInputs) {
+		for (size_t bit = 0; bit < nets.size(); ++bit) {
+			netNames[nets[bit]] = name + (nets.size() > 1 ? "[" + to_string(bit) + "]" : "");
+		}
+	}
+
+	// A wire may be driven by at most one source
+	vector<int> drivers(numNets, 0);
+	++drivers[falseNet];
+	++drivers[trueNet];
+	for (auto& [name, nets] : topInputs) {
+		for (int net : nets) ++drivers[net];
+	}
+	for (auto& gate : gates) {
+		if (gate.out >= 0 && ++drivers[gate.out] > 1) {
+			error(gate.instance, "output is connected to a wire that already has a driver.");
+			return false;
+		}
+	}
+	for (auto& [name, nets] : topInputs) {
+		for (int net : nets) {
+			if (drivers[net] > 1) {
+				error(0, "input pin " + name + " is driven from inside the chip.");
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool Netlist::instantiate(const ChipDef& chip, const vector<int>& inputNets, const vector<int>& outputNets, int instance, int depth)
+{
+	if (depth > MAX_NESTING) {
+		error(instance, "parts are nested too deeply, does the chip contain itself?");
+		return false;
+	}
+
+	if (chip.isPrimitive) {
+		if (chip.name == "Nand") gates.push_back({ GateKind::NAND, { inputNets[0], inputNets[1] }, outputNets[0], instance });
+		else gates.push_back({ GateKind::DFF, { inputNets[0], -1 }, outputNets[0], instance });
+		return true;
+	}
+	if (chip.isBlackBox) {
+		for (int net : inputNets) gates.push_back({ GateKind::BLACK_BOX_IN, { net, -1 }, -1, instance });
+		for (int net : outputNets) gates.push_back({ GateKind::BLACK_BOX_OUT, { -1, -1 }, net, instance });
+		++blackBoxCounts[chip.name];
+		return true;
+	}
+
+	// Nets visible inside this chip: its own pins plus internal buses
+	map<string, vector<int>> scope;
+	size_t offset = 0;
+	for (auto& pin : chip.inputs) {
+		scope[pin.name].assign(inputNets.begin() + offset, inputNets.begin() + offset + pin.width);
+		offset += pin.width;
+	}
+	offset = 0;
+	for (auto& pin : chip.outputs) {
+		scope[pin.name].assign(outputNets.begin() + offset, outputNets.begin() + offset + pin.width);
+		offset += pin.width;
+	}
+
+	// Internal buses take their width from the part outputs that drive them
+	map<string, int> internalWidths;
+	for (auto& part : chip.parts) {
+		const ChipDef* sub = library.get(part.chipName);
+		if (sub == nullptr) {
+			failed = true;
+			return false;
+		}
+		for (auto& conn : part.connections) {
+			const PinDecl* outPin = sub->findOutput(conn.inner.name);
+			if (outPin == nullptr || conn.outer.isConstant() || scope.count(conn.outer.name)) continue;
+			int width = conn.inner.hasRange ? conn.inner.hi - conn.inner.lo + 1 : outPin->width;
+			if (conn.outer.hasRange) width = conn.outer.hi + 1;
+			internalWidths[conn.outer.name] = max(internalWidths[conn.outer.name], width);
+		}
+	}
+	for (auto& [name, width] : internalWidths) {
+		for (int bit = 0; bit < width; ++bit) scope[name].push_back(newNet());
+	}
+
+	for (size_t partIdx = 0; partIdx < chip.parts.size(); ++partIdx) {
+		const Part& part = chip.parts[partIdx];
+		const ChipDef* sub = library.get(part.chipName);
+		int child = static_cast<int>(instances.size());
+		instances.push_back({ instance, sub, static_cast<int>(partIdx) });
+
+		vector<int> subInputs(totalWidth(sub->inputs), falseNet); // unconnected inputs read as false
+		vector<int> subOutputs(totalWidth(sub->outputs));
+		for (auto& net : subOutputs) net = newNet();
+
+		for (auto& conn : part.connections) {
+			const PinDecl* pin = sub->findInput(conn.inner.name);
+			bool isInput = pin != nullptr;
+			if (!isInput) pin = sub->findOutput(conn.inner.name);
+			if (pin == nullptr) {
+				error(instance, "line " + to_string(part.line) + ": " + sub->name + " has no pin named " + conn.inner.name);
+				return false;
+			}
+			const vector<PinDecl>& pins = isInput ? sub->inputs : sub->outputs;
+			size_t pinOffset = 0;
+			for (auto& decl : pins) {
+				if (&decl == pin) break;
+				pinOffset += decl.width;
+			}
+			int innerLo = conn.inner.hasRange ? conn.inner.lo : 0;
+			int innerHi = conn.inner.hasRange ? conn.inner.hi : pin->width - 1;
+			if (innerHi >= pin->width) {
+				error(instance, "line " + to_string(part.line) + ": sub-bus " + conn.inner.name + "[" + to_string(innerHi) + "] is out of range");
+				return false;
+			}
+			int innerWidth = innerHi - innerLo + 1;
+
+			vector<int> outerNets;
+			if (conn.outer.isConstant()) {
+				if (!isInput) continue; // e.g. carry=false, the output is discarded
+				outerNets.assign(innerWidth, conn.outer.name == "true" ? trueNet : falseNet);
+			}
+			else {
+				auto scopeIt = scope.find(conn.outer.name);
+				if (scopeIt == scope.end()) {
+					error(instance, "line " + to_string(part.line) + ": " + conn.outer.name + " is never driven by any part");
+					return false;
+				}
+				if (!isInput && chip.findInput(conn.outer.name)) {
+					error(instance, "line " + to_string(part.line) + ": input pin " + conn.outer.name + " cannot be driven by a part");
+					return false;
+				}
+				const vector<int>& bus = scopeIt->second;
+				int outerLo = conn.outer.hasRange ? conn.outer.lo : 0;
+				int outerHi = conn.outer.hasRange ? conn.outer.hi : static_cast<int>(bus.size()) - 1;
+				if (outerHi >= static_cast<int>(bus.size())) {
+					error(instance, "line " + to_string(part.line) + ": sub-bus " + conn.outer.name + "[" + to_string(outerHi) + "] is out of range");
+					return false;
+				}
+				outerNets.assign(bus.begin() + outerLo, bus.begin() + outerHi + 1);
+			}
+
+			if (static_cast<int>(outerNets.size()) != innerWidth) {
+				error(instance, "line " + to_string(part.line) + ": width of " + conn.inner.name + " (" + to_string(innerWidth) +
+					") does not match " + conn.outer.name + " (" + to_string(outerNets.size()) + ")");
+				return false;
+			}
+			for (int bit = 0; bit < innerWidth; ++bit) {
+				if (isInput) subInputs[pinOffset + innerLo + bit] = outerNets[bit];
+				else merge(outerNets[bit], subOutputs[pinOffset + innerLo + bit]);
+			}
+		}
+
+		if (!instantiate(*sub, subInputs, subOutputs, child, depth + 1)) return false;
+	}
+	return true;
+}
+
+NetlistAnalyzer::NetlistAnalyzer(const Netlist& netlist): netlist(netlist)
+{
+	computeDepths();
+}
+
+bool NetlistAnalyzer::hasCombinationalLoop()
+{
+	return unevaluatedGates > 0;
+}
+
+void NetlistAnalyzer::computeDepths()
+{
+	const auto& gates = netlist.gates;
+	netDepth.assign(netlist.numNets, 0);
+	netDriver.assign(netlist.numNets, -1);
+	fanout.assign(netlist.numNets, 0);
+
+	for (size_t g = 0; g < gates.size(); ++g) {
+		if (gates[g].out >= 0) netDriver[gates[g].out] = static_cast<int>(g);
+		for (int in : gates[g].in) {
+			if (in >= 0) ++fanout[in];
+		}
+		if (gates[g].kind == GateKind::NAND) ++nandCount;
+		else if (gates[g].kind == GateKind::DFF) ++dffCount;
+	}
+
+	// Consumers of each net, stored flat (CSR) since a RAM16K has millions of gates
+	vector<int> consumerStart(netlist.numNets + 1, 0);
+	for (auto& gate : gates) {
+		if (gate.kind != GateKind::NAND) continue;
+		for (int in : gate.in) ++consumerStart[in + 1];
+	}
+	partial_sum(consumerStart.begin(), consumerStart.end(), consumerStart.begin());
+	vector<int> consumers(consumerStart.back());
+	vector<int> fill(consumerStart.begin(), consumerStart.end() - 1);
+	vector<int> pending(gates.size(), 0);
+	for (size_t g = 0; g < gates.size(); ++g) {
+		if (gates[g].kind != GateKind::NAND) continue;
+		for (int in : gates[g].in) {
+			consumers[fill[in]++] = static_cast<int>(g);
+			int driver = netDriver[in];
+			if (driver >= 0 && gates[driver].kind == GateKind::NAND) ++pending[g];
+		}
+	}
+
+	// Levelize in topological order; DFF outputs, inputs and constants start at depth 0
+	vector<int> ready;
+	for (size_t g = 0; g < gates.size(); ++g) {
+		if (gates[g].kind == GateKind::NAND && pending[g] == 0) ready.push_back(static_cast<int>(g));
+	}
+	int evaluated = 0;
+	levelled.assign(gates.size(), false);
+	while (!ready.empty()) {
+		int g = ready.back();
+		ready.pop_back();
+		++evaluated;
+		levelled[g] = true;
+		const Gate& gate = gates[g];
+		netDepth[gate.out] = 1 + max(netDepth[gate.in[0]], netDepth[gate.in[1]]);
+		for (int c = consumerStart[gate.out]; c < consumerStart[gate.out + 1]; ++c) {
+			if (--pending[consumers[c]] == 0) ready.push_back(consumers[c]);
+		}
+	}
+	unevaluatedGates = nandCount - evaluated;
+}
+
+vector<int> NetlistAnalyzer::criticalPath(int sinkNet, int& sourceNet, bool& truncated)
+{
+	// Depths fall by one per levelled gate, so the walk ends. A gate on or behind a combinational
+	// loop has no depth to follow; the path stops there and is reported as truncated.
+	vector<int> path;
+	int net = sinkNet;
+	truncated = false;
+	while (netDriver[net] >= 0 && netlist.gates[netDriver[net]].kind == GateKind::NAND) {
+		const Gate& gate = netlist.gates[netDriver[net]];
+		path.push_back(netDriver[net]);
+		if (!levelled[netDriver[net]]) {
+			truncated = true;
+			break;
+		}
+		net = netDepth[gate.in[0]] >= netDepth[gate.in[1]] ? gate.in[0] : gate.in[1];
+	}
+	sourceNet = net;
+	reverse(path.begin(), path.end());
+	return path;
+}
+
+static string jsonString(const string& text)
+{
+	string out = "\"";
+	for (char c : text) {
+		if (c == '"' || c == '\\') out += '\\';
+		out += c;
+	}
+	return out + "\"";
+}
+
+void NetlistAnalyzer::writeJson(ostream& out, int topN)
+{
+	const auto& gates = netlist.gates;
+	auto describeNet = [&](int net) {
+		string name = netlist.netName(net);
+		if (!name.empty()) return name;
+		if (netDriver[net] >= 0) return netlist.instancePath(gates[netDriver[net]].instance);
+		return string("(undriven)");
+	};
+
+	// The deepest sink is either a chip output or the input of a DFF / built-in chip
+	int deepestNet = -1;
+	string deepestSink;
+	auto considerSink = [&](int net, const string& sink) {
+		if (deepestNet < 0 || netDepth[net] > netDepth[deepestNet]) {
+			deepestNet = net;
+			deepestSink = sink;
+		}
+	};
+
+	out << "{\n";
+	out << "  \"chip\": " << jsonString(netlist.top()->name) << ",\n";
+	out << "  \"nandCount\": " << nandCount << ",\n";
+	out << "  \"dffCount\": " << dffCount << ",\n";
+	out << "  \"blackBoxes\": {";
+	bool first = true;
+	for (auto& [name, count] : netlist.blackBoxCounts) {
+		out << (first ? " " : ", ") << jsonString(name) << ": " << count;
+		first = false;
+	}
+	out << (first ? "},\n" : " },\n");
+
+	out << "  \"outputs\": [";
+	first = true;
+	for (auto& pin : netlist.top()->outputs) {
+		const vector<int>& nets = netlist.topOutputs.at(pin.name);
+		int pinDepth = 0;
+		for (size_t bit = 0; bit < nets.size(); ++bit) {
+			pinDepth = max(pinDepth, netDepth[nets[bit]]);
+			considerSink(nets[bit], "out:" + pin.name + (nets.size() > 1 ? "[" + to_string(bit) + "]" : ""));
+		}
+		out << (first ? "\n" : ",\n") << "    { \"pin\": " << jsonString(pin.name) << ", \"width\": " << pin.width
+			<< ", \"depth\": " << pinDepth << ", \"bitDepths\": [";
+		for (size_t bit = 0; bit < nets.size(); ++bit) {
+			out << (bit > 0 ? ", " : "") << netDepth[nets[bit]];
+		}
+		out << "] }";
+		first = false;
+	}
+	out << (first ? "],\n" : "\n  ],\n");
+
+	int registerDepth = 0;
+	for (auto& gate : gates) {
+		if (gate.kind == GateKind::DFF || gate.kind == GateKind::BLACK_BOX_IN) {
+			registerDepth = max(registerDepth, netDepth[gate.in[0]]);
+			considerSink(gate.in[0], netlist.instancePath(gate.instance));
+		}
+	}
+	out << "  \"registerInputDepth\": " << registerDepth << ",\n";
+
+	out << "  \"criticalPath\": {";
+	if (deepestNet >= 0) {
+		int sourceNet = -1;
+		bool truncated = false;
+		vector<int> path = criticalPath(deepestNet, sourceNet, truncated);
+		out << "\n    \"depth\": " << netDepth[deepestNet] << ",\n"
+			<< "    \"from\": " << jsonString(describeNet(sourceNet)) << ",\n"
+			<< "    \"to\": " << jsonString(deepestSink) << ",\n"
+			<< "    \"truncated\": " << (truncated ? "true" : "false") << ",\n"
+			<< "    \"gates\": [";
+		for (size_t i = 0; i < path.size(); ++i) {
+			out << (i > 0 ? ",\n      " : "\n      ") << jsonString(netlist.instancePath(gates[path[i]].instance));
+		}
+		out << (path.empty() ? "]\n  " : "\n    ]\n  ");
+	}
+	out << "},\n";
+
+	// Constants are tied off rather than routed, so they are left out of the hotspots
+	vector<int> byFanout;
+	for (int net = 0; net < netlist.numNets; ++net) {
+		if (fanout[net] > 0 && net != netlist.trueNet && net != netlist.falseNet) byFanout.push_back(net);
+	}
+	int shown = min(topN, static_cast<int>(byFanout.size()));
+	partial_sort(byFanout.begin(), byFanout.begin() + shown, byFanout.end(), [&](int a, int b) { return fanout[a] > fanout[b]; });
+	out << "  \"fanoutHotspots\": [";
+	first = true;
+	for (int i = 0; i < shown; ++i) {
+		out << (first ? "\n" : ",\n") << "    { \"net\": " << jsonString(describeNet(byFanout[i])) << ", \"fanout\": " << fanout[byFanout[i]] << " }";
+		first = false;
+	}
+	out << (first ? "]\n" : "\n  ]\n");
+	out << "}\n";
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "HDLParser.h"
+#include <string>
+#include <vector>
+#include <map>
+
+enum class GateKind { NAND, DFF, BLACK_BOX_IN, BLACK_BOX_OUT };
+
+struct Gate {
+	GateKind kind;
+	int in[2] = { -1, -1 }; // nets read by the gate
+	int out = -1;           // net driven by the gate
+	int instance = -1;      // leaf instance the gate belongs to
+};
+
+// A chip flattened down to Nand gates and DFFs, one net per wire bit
+class Netlist
+{
+public:
+	Netlist(ChipLibrary& library);
+	bool build(const std::string& topChip);
+
+	std::string instancePath(int instance) const;
+	std::string netName(int net) const;
+	const ChipDef* top() const;
+
+	// Resolved after build(): nets are merged so every bit has a single id
+	std::vector<Gate> gates;
+	std::map<std::string, std::vector<int>> topInputs;
+	std::map<std::string, std::vector<int>> topOutputs;
+	std::map<std::string, int> blackBoxCounts;
+	int numNets = 0;
+	int falseNet = -1;
+	int trueNet = -1;
+
+private:
+	struct Instance {
+		int parent;
+		const ChipDef* chip;
+		int partIdx; // index of the part within the parent's PARTS section
+	};
+
+	ChipLibrary& library;
+	const ChipDef* topDef = nullptr;
+	std::vector<int> netParent; // union-find over nets
+	std::vector<Instance> instances;
+	std::vector<std::string> netNames; // only top-level pins are named
+	bool failed = false;
+
+	int newNet();
+	int find(int net);
+	void merge(int a, int b);
+	bool instantiate(const ChipDef& chip, const std::vector<int>& inputNets, const std::vector<int>& outputNets, int instance, int depth);
+	void error(int instance, const std::string& message);
+};
+
+// Longest Nand path per sink, critical path and fan-out hotspots over a flattened netlist
+class NetlistAnalyzer
+{
+public:
+	NetlistAnalyzer(const Netlist& netlist);
+	bool hasCombinationalLoop();
+	void writeJson(std::ostream& out, int topN);
+
+private:
+	const Netlist& netlist;
+	std::vector<int> netDepth;
+	std::vector<int> netDriver; // gate driving each net, -1 for inputs and constants
+	std::vector<bool> levelled; // gates given a depth, which leaves out those on or behind a combinational loop
+	std::vector<int> fanout;
+	int unevaluatedGates = 0;
+	int nandCount = 0;
+	int dffCount = 0;
+
+	void computeDepths();
+	std::vector<int> criticalPath(int sinkNet, int& sourceNet, bool& truncated);
+};
@@ -0,0 +1,18 @@
+#include "FrontEnd.h"
+#include "../JackCompiler/JackTokenizer.h"
+#include "../JackCompiler/CompilationEngine.h"
+#include "../JackCompiler/VMWriter.h"
+
+using namespace std;
+
+bool compileClass(const string& jackFile, string& vmCode)
+{
+	JackTokenizer tokenizer(jackFile);
+	if (tokenizer.didFailOpen()) {
+		return false;
+	}
+	VMWriter vm;
+	CompilationEngine ce(tokenizer, vm);
+	vmCode = vm.takeOutput();
+	return !ce.hadErrors();
+}
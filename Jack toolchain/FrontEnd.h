@@ -0,0 +1,9 @@
+#pragma once
+#include <string>
+
+// The Jack compiler as seen by the driver. It lives in its own translation unit because the
+// compiler and the VM translator each define their own Segment and Command enums.
+
+// Compiles one .jack file to VM code in memory, false if the file could not be read or had
+// errors (which the compiler has reported)
+bool compileClass(const std::string& jackFile, std::string& vmCode);
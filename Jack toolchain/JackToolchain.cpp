@@ -0,0 +1,165 @@
+#include "FrontEnd.h"
+#include "../VM translator/Parser.h"
+#include "../VM translator/CodeWriter.h"
+#include "../VM translator/Translation.h"
+#include "../VM translator/BuildCache.h"
+#include "../VM translator/HackObject.h"
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <filesystem>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+using namespace std;
+
+// One class on its way from the compiler to the VM translator
+struct CompiledClass {
+    string vmName;
+    string vmCode;
+    bool fromDisk = false; // precompiled, vmName is the path of the .vm file
+    bool failed = false;
+};
+
+// Handed from the compiler thread to the translator, in compilation order
+class ClassQueue
+{
+public:
+    void push(CompiledClass compiled) {
+        {
+            lock_guard<mutex> lock(guard);
+            classes.push_back(std::move(compiled));
+        }
+        ready.notify_one();
+    }
+    CompiledClass pop() {
+        unique_lock<mutex> lock(guard);
+        ready.wait(lock, [this] { return !classes.empty(); });
+        CompiledClass compiled = std::move(classes.front());
+        classes.pop_front();
+        return compiled;
+    }
+
+private:
+    mutex guard;
+    condition_variable ready;
+    deque<CompiledClass> classes;
+};
+
+int main(int argc, char *argv[])
+{
+    string dir;
+    TranslationOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!options.parse(i, argc, argv)) {
+            dir = argv[i];
+        }
+    }
+    if (dir.empty()) {
+        std::cout << "Enter program directory: ";
+        std::cin >> dir;
+        std::cout << endl;
+    }
+
+    auto start = chrono::high_resolution_clock::now();
+    filesystem::directory_iterator dirIt;
+    try {
+        dirIt = filesystem::directory_iterator(dir);
+    }
+    catch (filesystem::filesystem_error) {
+        std::cout << "Invalid directory name, unable to open. Closing..." << endl;
+        return -1;
+    }
+
+    // Classes are compiled from .jack where the source is present. A .vm without a .jack next
+    // to it (such as a precompiled OS class) is read as it is.
+    vector<filesystem::path> osSources, userSources;
+    for (auto& p : dirIt) {
+        filesystem::path path = p.path();
+        string extension = path.extension().string();
+        if (extension == ".vm" && filesystem::exists(filesystem::path(path).replace_extension(".jack"))) continue;
+        if (extension != ".jack" && extension != ".vm") continue;
+        string vmName = path.stem().string() + ".vm";
+        if (std::find(osFiles.begin(), osFiles.end(), vmName) != osFiles.end()) osSources.push_back(path);
+        else userSources.push_back(path);
+    }
+    // Same order as the VM translator: OS classes first, followed by the user's classes
+    std::sort(osSources.begin(), osSources.end(), [](auto& a, auto& b) {
+        auto index = [](const filesystem::path& path) { return std::find(osFiles.begin(), osFiles.end(), path.stem().string() + ".vm") - osFiles.begin(); };
+        return index(a) < index(b);
+    });
+    std::sort(userSources.begin(), userSources.end()); // the same ROM whatever order the directory lists
+    vector<filesystem::path> sources = osSources;
+    sources.insert(sources.end(), userSources.begin(), userSources.end());
+
+    // Class N + 1 is compiled while class N is decoded. Code generation itself needs the whole
+    // program (dead code analysis, inlining, frame layout) and starts once the last class is in.
+    ClassQueue queue;
+    thread compiler([&] {
+        for (auto& source : sources) {
+            CompiledClass compiled;
+            compiled.vmName = source.stem().string() + ".vm";
+            if (source.extension().string() == ".jack") {
+                compiled.failed = !compileClass(source.string(), compiled.vmCode);
+            }
+            else {
+                compiled.vmName = source.string();
+                compiled.fromDisk = true;
+            }
+            queue.push(std::move(compiled));
+        }
+    });
+
+    VMProgram program;
+    bool failed = false;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        CompiledClass compiled = queue.pop();
+        if (failed || compiled.failed) {
+            failed = true;
+            continue; // keep draining so the compiler thread can finish
+        }
+        std::cout << "Loading " << compiled.vmName << endl;
+        unique_ptr<Parser> parser = compiled.fromDisk ? make_unique<Parser>(compiled.vmName) : make_unique<Parser>(compiled.vmName, std::move(compiled.vmCode));
+        if (parser->didFailOpen()) {
+            failed = true;
+            continue;
+        }
+        parser->parse(program);
+        parser->close();
+    }
+    compiler.join();
+    if (failed) {
+        return -1;
+    }
+
+    CodeWriter codeWriter;
+    unique_ptr<BuildCache> cache;
+    if (options.useCache) {
+        cache = make_unique<BuildCache>(filesystem::path(dir) / ".buildcache");
+        codeWriter.setCache(cache.get());
+    }
+    codeWriter.setDirectEncoding(encodesDirectly(options));
+    if (!translateProgram(program, true, options, codeWriter)) {
+        return -1;
+    }
+    std::cout << "Translated to " << codeWriter.output().instructionCount() << " instructions." << endl;
+
+    // Only the ROM is written, next to the directory like the translator's .asm. Instructions are
+    // encoded as they are translated, so there is no assembly to write out or parse again.
+    string outputName = dir;
+    if (outputName.back() == '/' || outputName.back() == '\\') outputName.pop_back();
+    vector<uint16_t> rom;
+    if (!encodeProgram(codeWriter, dir, options, nullptr, rom) || !writeHack(outputName + ".hack", rom)) {
+        return -1;
+    }
+
+    auto stop = chrono::high_resolution_clock::now();
+    auto duration = chrono::duration_cast<chrono::milliseconds>(stop - start);
+    std::cout << "Finished building in " << duration.count() << "ms." << endl;
+}
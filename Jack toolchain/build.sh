@@ -0,0 +1,4 @@
+#!/bin/bash
+# Links the compiler and VM translator sources into one program, leaving out their own main files
+shopt -s extglob
+g++ -std=c++2a -O2 -pthread *.cpp ../JackCompiler/!(JackCompiler).cpp "../VM translator"/!(HackVMTranslator).cpp -o JackToolchain.o
@@ -1,6 +1,7 @@
 #include "CompilationEngine.h"
-#include "Shared.h"
+#include "../JackCompiler/Shared.h"
 #include <iostream>
+#include <map>
 
 using namespace std;
 
@@ -59,7 +60,7 @@ Status CompilationEngine::eat(Token tokenType, bool isOptional) {
 	if (tk->aborted()) return Status::FAILURE;
 	if (tk->tokenType() != tokenType) {
 		if (isOptional) return Status::NOT_FOUND;
-		cout << brightError << " at line " << tk->currPos() << ": Expected " << tokens[static_cast<int>(tokenType)] << " and got " << tk->stringVal() << " instead." << endl;
+		cout << brightError << " at line " << tk->currLineNum() << ", column " << tk->currColumn() << ": Expected " << tokens[static_cast<int>(tokenType)] << " and got " << tk->stringVal() << " instead." << endl;
 		return Status::SYNTAX_ERROR;
 	}
 	else {
@@ -72,7 +73,7 @@ Status CompilationEngine::eat(char symbol, bool isOptional) {
 	if (tk->aborted()) return Status::FAILURE;
 	if (tk->symbol() != symbol) {
 		if (isOptional) return Status::NOT_FOUND;
-		cout << brightError << " at line " << tk->currPos() << ": Expected '" << symbol << "' and got '" << tk->stringVal() << "' instead." << endl;
+		cout << brightError << " at line " << tk->currLineNum() << ", column " << tk->currColumn() << ": Expected '" << symbol << "' and got '" << tk->stringVal() << "' instead." << endl;
 		return Status::SYNTAX_ERROR;
 	}
 	else {
@@ -85,7 +86,7 @@ Status CompilationEngine::eat(Keyword keywordType, bool isOptional) {
 	if (tk->aborted()) return Status::FAILURE;
 	if (tk->keyword() != keywordType) {
 		if (isOptional) return Status::NOT_FOUND;
-		cout << brightError << " at line " << tk->currPos() << ": Expected " << reverseKeywordList.at(keywordType) << endl;
+		cout << brightError << " at line " << tk->currLineNum() << ", column " << tk->currColumn() << ": Expected " << reverseKeywordList.at(keywordType) << endl;
 		return Status::SYNTAX_ERROR;
 	}
 	else {
@@ -107,7 +108,7 @@ Status CompilationEngine::eatType(bool includeVoid, bool isOptional) {
 	}
 	else {
 		if (isOptional) return Status::NOT_FOUND;
-		cout << brightError << " at line " << tk->currPos() << ": Expected type" << endl;
+		cout << brightError << " at line " << tk->currLineNum() << ", column " << tk->currColumn() << ": Expected type" << endl;
 		return Status::SYNTAX_ERROR;
 	}
 }
@@ -125,7 +126,7 @@ Status CompilationEngine::eatOp(bool isOptional) {
 	auto opIt = tk->tokenType() == Token::SYMBOL ? ops.find(tk->symbol()) : ops.end();
 	if (opIt == ops.end()) {
 		if (isOptional) return Status::NOT_FOUND;
-		cout << brightError << " at line " << tk->currPos() << ": Expected operator. Got " << tk->stringVal() << " instead." << endl;
+		cout << brightError << " at line " << tk->currLineNum() << ", column " << tk->currColumn() << ": Expected operator. Got " << tk->stringVal() << " instead." << endl;
 		return Status::SYNTAX_ERROR;
 	}
 	else {
@@ -173,7 +174,7 @@ void CompilationEngine::compileClass()
 void CompilationEngine::checkVarDec() {
 	auto varsIt = definedVars.find(tk->stringVal());
 	if (varsIt == definedVars.end()) definedVars.insert(tk->stringVal());
-	else cout << brightError << " at line " << tk->currPos() << ": Attempting redefinition of already defined variable \"" << tk->stringVal() << "\"" << endl;
+	else cout << brightError << " at line " << tk->currLineNum() << ", column " << tk->currColumn() << ": Attempting redefinition of already defined variable \"" << tk->stringVal() << "\"" << endl;
 }
 
 void CompilationEngine::compileClassVarDec()
@@ -281,7 +282,7 @@ void CompilationEngine::compileLet()
 	eat(Keyword::LET);
 	auto varsIt = definedVars.find(tk->stringVal());
 	if (varsIt == definedVars.end()) {
-		cout << brightError << " at line " << tk->currPos() << ": Attempting to assign value to undeclared variable \"" << tk->stringVal() << "\"" << endl;
+		cout << brightError << " at line " << tk->currLineNum() << ", column " << tk->currColumn() << ": Attempting to assign value to undeclared variable \"" << tk->stringVal() << "\"" << endl;
 	}
 	eat(Token::IDENTIFIER);
 	if (eat('[', true) == Status::OK) {
@@ -2,7 +2,7 @@
 #include <string>
 #include <fstream>
 #include <set>
-#include "JackTokenizer.h"
+#include "../JackCompiler/JackTokenizer.h"
 
 class CompilationEngine
 {
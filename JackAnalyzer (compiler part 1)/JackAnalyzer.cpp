@@ -1,4 +1,4 @@
-#include "JackTokenizer.h"
+#include "../JackCompiler/JackTokenizer.h"
 #include "CompilationEngine.h"
 #include <iostream>
 #include <string>
@@ -0,0 +1,3 @@
+#!/bin/bash
+# The tokenizer is the compiler's, shared rather than copied
+g++ -std=c++2a -O2 *.cpp ../JackCompiler/JackTokenizer.cpp -o JackAnalyzer.o
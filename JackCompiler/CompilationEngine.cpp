@@ -1,7 +1,6 @@
 #include "CompilationEngine.h"
 #include "Shared.h"
 #include <iostream>
-#include <random>
 
 using namespace std;
 
@@ -54,15 +53,26 @@ CompilationEngine::CompilationEngine(JackTokenizer& tkA, VMWriter& vmA) : tk(tkA
 	if (tk.tokenType() == Token::KEYWORD && tk.keyword() == Keyword::CLASS)
 		compileClass();
 	else {
-		cout << brightError << ": File does not begin with class declaration." << endl;
+		error() << ": File does not begin with class declaration." << endl;
 	}
 }
 
+ostream& CompilationEngine::error()
+{
+	++errorCount;
+	return cout << brightError;
+}
+
+bool CompilationEngine::hadErrors() const
+{
+	return errorCount > 0 || tk.aborted();
+}
+
 Status CompilationEngine::eat(Token tokenType, bool isOptional) {
 	if (tk.aborted()) return Status::FAILURE;
 	if (tk.tokenType() != tokenType) {
 		if (isOptional) return Status::NOT_FOUND;
-		cout << brightError << " at line " << tk.currLineNum() << ": Expected " << tokens[static_cast<int>(tokenType)] << " and got " << tk.identifier() << " instead." << endl;
+		error() << " at line " << tk.currLineNum() << ", column " << tk.currColumn() << ": Expected " << tokens[static_cast<int>(tokenType)] << " and got " << tk.identifier() << " instead." << endl;
 		return Status::SYNTAX_ERROR;
 	}
 	else {
@@ -102,7 +112,7 @@ Status CompilationEngine::eat(char symbol, bool isOptional) {
 	if (tk.aborted()) return Status::FAILURE;
 	if (tk.symbol() != symbol) {
 		if (isOptional) return Status::NOT_FOUND;
-		cout << brightError << " at line " << tk.currLineNum() << ": Expected '" << symbol << "' and got '" << tk.identifier() << "' instead." << endl;
+		error() << " at line " << tk.currLineNum() << ", column " << tk.currColumn() << ": Expected '" << symbol << "' and got '" << tk.identifier() << "' instead." << endl;
 		return Status::SYNTAX_ERROR;
 	}
 	else {
@@ -115,7 +125,7 @@ Status CompilationEngine::eat(Keyword keywordType, bool isOptional) {
 	if (tk.aborted()) return Status::FAILURE;
 	if (tk.keyword() != keywordType) {
 		if (isOptional) return Status::NOT_FOUND;
-		cout << brightError << " at line " << tk.currLineNum() << ": Expected " << reverseKeywordList.at(keywordType) << endl;
+		error() << " at line " << tk.currLineNum() << ", column " << tk.currColumn() << ": Expected " << reverseKeywordList.at(keywordType) << endl;
 		return Status::SYNTAX_ERROR;
 	}
 	else {
@@ -137,7 +147,7 @@ Status CompilationEngine::eatType(bool includeVoid, bool isOptional) {
 	}
 	else {
 		if (isOptional) return Status::NOT_FOUND;
-		cout << brightError << " at line " << tk.currLineNum() << ": Expected type" << endl;
+		error() << " at line " << tk.currLineNum() << ", column " << tk.currColumn() << ": Expected type" << endl;
 		return Status::SYNTAX_ERROR;
 	}
 }
@@ -155,7 +165,7 @@ Status CompilationEngine::eatOp(bool isOptional, bool noAdvance) {
 	auto opIt = opMap.find(tk.symbol());
 	if (opIt == opMap.end()) {
 		if (isOptional) return Status::NOT_FOUND;
-		cout << brightError << " at line " << tk.currLineNum() << ": Expected operator. Got " << tk.identifier() << " instead." << endl;
+		error() << " at line " << tk.currLineNum() << ", column " << tk.currColumn() << ": Expected operator. Got " << tk.identifier() << " instead." << endl;
 		return Status::SYNTAX_ERROR;
 	}
 	else {
@@ -194,7 +204,7 @@ void CompilationEngine::checkVarDec(bool isClass) {
 	auto found = (isClass ? classTable : subroutineTable).getTable().find(tk.identifier());
 	auto end = (isClass ? classTable : subroutineTable).getTable().end();
 	if (found != end) {
-		cout << brightError << " at line " << tk.currLineNum() << ": Attempting redefinition of already defined variable \"" << tk.identifier() << "\"" << endl;
+		error() << " at line " << tk.currLineNum() << ", column " << tk.currColumn() << ": Attempting redefinition of already defined variable \"" << tk.identifier() << "\"" << endl;
 	}
 }
 
@@ -246,6 +256,8 @@ void CompilationEngine::compileClassVarDec()
 void CompilationEngine::compileSubroutineDec()
 {
 	subroutineTable.reset();
+	ifCount = 0;
+	whileCount = 0;
 	Keyword key = tk.keyword();
 	eat(Token::KEYWORD);
 	string classNameOrType = tk.identifier();
@@ -330,10 +342,10 @@ void CompilationEngine::compileStatements(const string& type)
 			compileLet();
 			break;
 		case Keyword::IF:
-			compileIf();
+			compileIf(type);
 			break;
 		case Keyword::WHILE:
-			compileWhile();
+			compileWhile(type);
 			break;
 		case Keyword::DO:
 			compileDo();
@@ -398,7 +410,7 @@ void CompilationEngine::compileLet()
 	std::tie(it, itResult) = getVarIt(varName);
 	
 	if (!itResult) {
-		cout << brightError << " at line " << tk.currLineNum() << ": Attempting to assign value to undeclared variable \"" << tk.identifier() << "\"" << endl;
+		error() << " at line " << tk.currLineNum() << ", column " << tk.currColumn() << ": Attempting to assign value to undeclared variable \"" << tk.identifier() << "\"" << endl;
 		return;
 	}
 	
@@ -426,28 +438,12 @@ void CompilationEngine::compileLet()
 	eat(';');
 }
 
-std::string random_string(std::size_t length)
-{
-	const std::string CHARACTERS = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
-
-	std::random_device random_device; // not the best seed but fine for our purposes
-	std::mt19937 generator(random_device());
-	std::uniform_int_distribution<> distribution(0, CHARACTERS.size() - 1);
-
-	std::string random_string;
-
-	for (std::size_t i = 0; i < length; ++i)
-	{
-		random_string += CHARACTERS[distribution(generator)];
-	}
-
-	return random_string;
-}
-
-void CompilationEngine::compileIf()
+void CompilationEngine::compileIf(const string& type)
 {
-	string elseBlock = random_string(20);
-	string afterIf = random_string(20);
+	// Numbered per subroutine, so the same source always compiles to the same code
+	string elseBlock = "IF_FALSE" + to_string(ifCount);
+	string afterIf = "IF_END" + to_string(ifCount);
+	++ifCount;
 	eat(Keyword::IF);
 	eat('(');
 	compileExpression();
@@ -456,22 +452,23 @@ void CompilationEngine::compileIf()
 	vm.writeArithmetic(Command::NOT);
 	vm.writeIf(elseBlock);
 	eat('{');
-	compileStatements();
+	compileStatements(type);
 	eat('}');
 	vm.writeGoto(afterIf);
 	vm.writeLabel(elseBlock);
 	if (eat(Keyword::ELSE, true) == Status::OK) {
 		eat('{');
-		compileStatements();
+		compileStatements(type);
 		eat('}');
 	}
 	vm.writeLabel(afterIf);
 }
 
-void CompilationEngine::compileWhile()
+void CompilationEngine::compileWhile(const string& type)
 {
-	string whileBlock = random_string(20);
-	string afterWhile = random_string(20);
+	string whileBlock = "WHILE_EXP" + to_string(whileCount);
+	string afterWhile = "WHILE_END" + to_string(whileCount);
+	++whileCount;
 	eat(Keyword::WHILE);
 	vm.writeLabel(whileBlock);
 	eat('(');
@@ -480,7 +477,7 @@ void CompilationEngine::compileWhile()
 	vm.writeArithmetic(Command::NOT);
 	vm.writeIf(afterWhile);
 	eat('{');
-	compileStatements();
+	compileStatements(type);
 	eat('}');
 	vm.writeGoto(whileBlock);
 	vm.writeLabel(afterWhile);
@@ -20,10 +20,10 @@ public:
 	void compileParameterList(bool isMethod = false);
 	void compileSubroutineBody(std::string& funName, std::string& type, Keyword key);
 	void compileVarDec();
-	void compileStatements(const std::string& type = std::string());
+	void compileStatements(const std::string& type); // type returned by the subroutine, for a bare return
 	void compileLet();
-	void compileIf();
-	void compileWhile();
+	void compileIf(const std::string& type);
+	void compileWhile(const std::string& type);
 	void compileDo();
 	void compileReturn(const std::string& type);
 	void compileExpression();
@@ -31,12 +31,17 @@ public:
 	int compileExpressionList();
 	void compileIdentifier(bool beingDefined, bool isSubroutine, const std::string& savedToken = std::string(), int argCount = 0);
 	void compileTermIdentifier();
+	bool hadErrors() const;
 	~CompilationEngine();
 private:
 	std::string className;
 	bool failedOpen = false;
+	int errorCount = 0;
+	int ifCount = 0;    // labels are numbered per subroutine
+	int whileCount = 0;
 	JackTokenizer& tk;
 	VMWriter& vm;
+	std::ostream& error(); // counts the error and starts its message
 	void advanceTk();
 	void checkVarDec(bool isClass);
 	ItWithResult getVarIt(const std::string& name);
@@ -1,26 +1,59 @@
 #include "JackTokenizer.h"
 #include "CompilationEngine.h"
+#include "../VM translator/BuildCache.h"
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <string>
 #include <chrono>
 #include <filesystem>
 #include <vector>
+#include <memory>
 
 using namespace std;
 
+// Part of every cache key; change it whenever the generated code changes
+static const string_view compilerVersion = "JackCompiler 2";
+
+static string readFile(const string& filename)
+{
+    ifstream file(filename, ios::binary);
+    ostringstream contents;
+    contents << file.rdbuf();
+    return std::move(contents).str();
+}
+
 int main(int argc, char* argv[])
 {
     string fileOrDir;
+    bool useCache = false; // -cache: reuse the VM code of classes whose source has not changed
+    bool toStdout = false; // -stdout: write the VM code of every class to stdout, e.g. into HackVMTranslator -
 
-    if (argc > 1) {
-        fileOrDir = argv[1];
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "-cache") {
+            useCache = true;
+        }
+        else if (arg == "-stdout") {
+            toStdout = true;
+        }
+        else {
+            fileOrDir = arg;
+        }
     }
-    else {
+    if (fileOrDir.empty()) {
         std::cout << "Enter .jack filename or directory: ";
         std::cin >> fileOrDir;
         std::cout << endl;
     }
 
+    // Messages go to stderr while stdout carries the VM code
+    streambuf* stdoutBuffer = cout.rdbuf();
+    if (toStdout) {
+        cout.rdbuf(cerr.rdbuf());
+    }
+    ostream vmStream(stdoutBuffer);
+
     auto start = chrono::high_resolution_clock::now();
     auto dotLoc = fileOrDir.find_first_of(".");
     bool isDirectory = false;
@@ -47,23 +80,54 @@ int main(int argc, char* argv[])
         files.push_back(fileOrDir);
     }
 
+    // Classes whose source has not changed since an earlier run are not compiled again
+    unique_ptr<BuildCache> cache;
+    if (useCache) {
+        cache = make_unique<BuildCache>((isDirectory ? filesystem::path(fileOrDir) : filesystem::path(fileOrDir).parent_path()) / ".buildcache");
+    }
+    int numReused = 0;
+
     for (auto& file : files) {
         cout << "Loading " << file << "..." << endl;
 
         string vmOutput = file.substr(0, file.find_last_of(".") + 1) + "vm";
-        JackTokenizer tokenizer(file);
-        VMWriter vm(vmOutput);
-        CompilationEngine ce(tokenizer, vm);
-
-        if (vm.didFailOpen()) {
-            return -1;
+        string vmCode;
+        uint64_t key = BuildCache::hash(readFile(file), BuildCache::hash(compilerVersion));
+        if (cache && cache->load(key, vmCode)) {
+            cout << "Unchanged since the last build, reusing its VM code." << endl;
+            ++numReused;
+        }
+        else {
+            JackTokenizer tokenizer(file);
+            if (tokenizer.didFailOpen()) {
+                return -1;
+            }
+            VMWriter vm;
+            CompilationEngine ce(tokenizer, vm);
+            vmCode = vm.takeOutput();
+            if (cache && !ce.hadErrors()) cache->store(key, vmCode); // errors are reported again next time
         }
 
-        vm.close();
+        if (toStdout) {
+            vmStream << vmCode;
+        }
+        // An up-to-date .vm is left alone, so tools watching it only see the classes that changed
+        else if (!filesystem::exists(vmOutput) || readFile(vmOutput) != vmCode) {
+            ofstream vm(vmOutput, ios::binary);
+            if (!vm.is_open()) {
+                cout << "Error opening file " << vmOutput << " for compiler output." << endl;
+                return -1;
+            }
+            vm << vmCode;
+            cout << "Wrote " << vmOutput << endl;
+        }
         cout << "===========" << endl;
     }
     auto stop = chrono::high_resolution_clock::now();
     auto duration = chrono::duration_cast<chrono::milliseconds>(stop - start);
+    if (cache) cout << "Reused " << numReused << " of " << files.size() << " classes from the cache." << endl;
     cout << "Finished analysis in " << duration.count() << "ms." << endl;
+    vmStream.flush();
+    cout.rdbuf(stdoutBuffer);
 
 }
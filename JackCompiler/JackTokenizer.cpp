@@ -2,12 +2,16 @@
 #include <iostream>
 #include <fstream>
 #include <map>
-#include <set>
-#include <regex>
+#include <array>
+#include <charconv>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 
-static const map<string, Keyword> keywordList = {
+static const map<string_view, Keyword> keywordList = {
 	{"class", Keyword::CLASS},
 	{"method", Keyword::METHOD},
 	{"function", Keyword::FUNCTION},
@@ -31,193 +35,261 @@ static const map<string, Keyword> keywordList = {
 	{"this", Keyword::THIS }
 };
 
-static const set<char> symbols = {
-	'{', '}', '(', ')', '[', ']', '.', ',', ';', '+', '-', '*', '/', '&', '|', '<', '>', '=', '~'
+static const char* tokenNames[] = { "keyword", "symbol", "identifier", "integerConstant", "stringConstant" };
+
+static const char* brightError = "\x1B[91mERROR\033[0m";
+
+// Character classes; END is the end of the file, which has no byte
+enum CharClass : uint8_t { SPACE, NEWLINE, LETTER, DIGIT, SYMBOL, STAR, SLASH, QUOTE, OTHER, END, NUM_CLASSES };
+
+static constexpr array<uint8_t, 256> makeCharClasses()
+{
+	array<uint8_t, 256> classes{};
+	for (auto& c : classes) c = OTHER;
+	classes[' '] = classes['\t'] = classes['\r'] = classes['\f'] = classes['\v'] = SPACE;
+	classes['\n'] = NEWLINE;
+	for (int c = 'a'; c <= 'z'; ++c) classes[c] = LETTER;
+	for (int c = 'A'; c <= 'Z'; ++c) classes[c] = LETTER;
+	classes['_'] = LETTER;
+	for (int c = '0'; c <= '9'; ++c) classes[c] = DIGIT;
+	for (char c : { '{', '}', '(', ')', '[', ']', '.', ',', ';', '+', '-', '&', '|', '<', '>', '=', '~' }) classes[static_cast<uint8_t>(c)] = SYMBOL;
+	classes['*'] = STAR;
+	classes['/'] = SLASH;
+	classes['"'] = QUOTE;
+	return classes;
+}
+static constexpr array<uint8_t, 256> charClasses = makeCharClasses();
+
+enum State : uint8_t { START, IDENT, NUMBER, STRING, AFTER_SLASH, LINE_COMMENT, BLOCK_COMMENT, BLOCK_STAR, NUM_STATES };
+
+// What a transition does besides changing state. Only the actions marked "again" leave the
+// character for the next state to look at; all others consume it.
+enum Action : uint8_t {
+	NONE,
+	BEGIN,         // a token starts at this character
+	BEGIN_STRING,  // a string constant starts after this quote
+	EMIT_SYMBOL,   // the character is a token of its own
+	EMIT,          // the identifier or number ended before this character (again)
+	EMIT_STRING,   // the closing quote
+	EMIT_SLASH,    // the '/' before this character was division (again)
+	BAD_CHARACTER,
+	BAD_STRING,    // end of line or file inside a string constant
+	STOP
 };
 
-static const char * tokens[] = { "keyword", "symbol", "name", "integerConstant", "stringConstant" }; // "name" is identifier name
+struct Transition {
+	State next;
+	Action action;
+};
 
-static const char* brightError = "\x1B[91mERROR\033[0m";
+static constexpr array<array<Transition, NUM_CLASSES>, NUM_STATES> makeTransitions()
+{
+	array<array<Transition, NUM_CLASSES>, NUM_STATES> table{};
+	auto all = [&](State state, Transition transition) {
+		for (auto& entry : table[state]) entry = transition;
+	};
+
+	table[START] = { {
+		{ START, NONE }, { START, NONE }, { IDENT, BEGIN }, { NUMBER, BEGIN }, { START, EMIT_SYMBOL }, { START, EMIT_SYMBOL },
+		{ AFTER_SLASH, BEGIN }, { STRING, BEGIN_STRING }, { START, BAD_CHARACTER }, { START, STOP }
+	} };
+	all(IDENT, { START, EMIT });
+	table[IDENT][LETTER] = table[IDENT][DIGIT] = { IDENT, NONE };
+	all(NUMBER, { START, EMIT });
+	table[NUMBER][DIGIT] = { NUMBER, NONE };
+	all(STRING, { STRING, NONE });
+	table[STRING][QUOTE] = { START, EMIT_STRING };
+	table[STRING][NEWLINE] = table[STRING][END] = { START, BAD_STRING };
+	all(AFTER_SLASH, { START, EMIT_SLASH });
+	table[AFTER_SLASH][SLASH] = { LINE_COMMENT, NONE };
+	table[AFTER_SLASH][STAR] = { BLOCK_COMMENT, NONE };
+	all(LINE_COMMENT, { LINE_COMMENT, NONE });
+	table[LINE_COMMENT][NEWLINE] = { START, NONE };
+	table[LINE_COMMENT][END] = { START, STOP };
+	all(BLOCK_COMMENT, { BLOCK_COMMENT, NONE }); // also covers /** doc comments
+	table[BLOCK_COMMENT][STAR] = { BLOCK_STAR, NONE };
+	table[BLOCK_COMMENT][END] = { START, STOP };
+	all(BLOCK_STAR, { BLOCK_COMMENT, NONE });
+	table[BLOCK_STAR][STAR] = { BLOCK_STAR, NONE };
+	table[BLOCK_STAR][SLASH] = { START, NONE };
+	table[BLOCK_STAR][END] = { START, STOP };
+	return table;
+}
+static constexpr auto transitions = makeTransitions();
 
 JackTokenizer::JackTokenizer(const std::string& inputFilename)
 {
-	inFile.open(inputFilename);
-	if (inFile.is_open()) {
-		cout << "Successfully opened " << inputFilename << "." << endl;
-		stripAllComments();
-	}
-	else {
+	int fd = ::open(inputFilename.c_str(), O_RDONLY);
+	struct stat info;
+	if (fd < 0 || fstat(fd, &info) != 0) {
+		if (fd >= 0) ::close(fd);
 		cout << "Error opening file" << inputFilename << " for input." << endl;
 		failedOpen = true;
+		return;
 	}
-}
-
-void JackTokenizer::stripAllComments() {
-	string line;
-	bool isMultiLine = false;
-	int lineNum = 1;
-	int writtenChars = 0;
-	lineNums.emplace(lineNum, writtenChars);
-	while (getline(inFile, line)) {
-		++lineNum;
-		if (isMultiLine) {
-			size_t endOfComment = line.find("*/");
-			if (endOfComment == string::npos) {
-				continue;
-			}
-			else {
-				line.erase(0, endOfComment + 2);
-				isMultiLine = false;
-			}
+	cout << "Successfully opened " << inputFilename << "." << endl;
+	if (info.st_size > 0) {
+		void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped != MAP_FAILED) {
+			mapping = mapped;
+			mappingSize = static_cast<size_t>(info.st_size);
+			source = string_view(static_cast<const char*>(mapped), mappingSize);
 		}
-		isMultiLine = removeComments(line);
-		if (line.length() == 0) continue;
-		writtenChars += line.length() +1; // plus 1 for space
-		lineNums.emplace(lineNum, writtenChars);
-		strippedText << line << " "; // use spaces instead of newline
 	}
-	strippedText.seekg(0);
-}
-
-bool JackTokenizer::removeComments(string& line) {
-	size_t slashPos = line.find("//");
-	bool isMultiLine = false;
-	if (slashPos == 0) { // entire line is a comment
-		line.clear();
-		return isMultiLine;
+	::close(fd);
+	if (!mapping) { // empty, or not something that can be mapped
+		ifstream inFile(inputFilename, ios::binary);
+		buffer.assign(istreambuf_iterator<char>(inFile), istreambuf_iterator<char>());
+		source = buffer;
 	}
-	if (slashPos != string::npos)
-		line.erase(slashPos);
-
-	size_t longComment = line.find("/*"); // will cover doc comments as well (/**)
+	isOpen = true;
+	scan();
+}
 
-	if (longComment != string::npos) {
-		size_t endOfComment = line.find("*/");
-		if (endOfComment != string::npos) {
-			line.erase(longComment, endOfComment + 2);
+void JackTokenizer::scan() {
+	tokens.reserve(source.size() / 4);
+	const size_t size = source.size();
+	State state = START;
+	size_t start = 0;
+	int line = 1;
+	size_t lineStart = 0;
+	int tokenLine = 1;
+	int tokenColumn = 1;
+	auto emit = [&](Token type, size_t end) {
+		TokenSpan token;
+		token.type = type;
+		token.offset = static_cast<uint32_t>(start);
+		token.length = static_cast<uint32_t>(end - start);
+		token.line = tokenLine;
+		token.column = tokenColumn;
+		if (type == Token::IDENTIFIER) {
+			auto keywordIt = keywordList.find(source.substr(start, end - start));
+			if (keywordIt != keywordList.end()) {
+				token.type = Token::KEYWORD;
+				token.keyword = keywordIt->second;
+			}
 		}
-		else {
-			isMultiLine = true;
-			if (longComment == 0) {
-				line.clear();
-				return isMultiLine;
+		tokens.push_back(token);
+	};
+
+	for (size_t pos = 0;;) {
+		const uint8_t charClass = (pos < size ? charClasses[static_cast<uint8_t>(source[pos])] : static_cast<uint8_t>(END));
+		const Transition transition = transitions[state][charClass];
+		bool consume = true;
+		switch (transition.action) {
+		case NONE:
+			break;
+		case BEGIN:
+			start = pos;
+			tokenLine = line;
+			tokenColumn = static_cast<int>(pos - lineStart) + 1;
+			break;
+		case BEGIN_STRING:
+			start = pos + 1;
+			tokenLine = line;
+			tokenColumn = static_cast<int>(pos - lineStart) + 1;
+			break;
+		case EMIT_SYMBOL:
+			start = pos;
+			tokenLine = line;
+			tokenColumn = static_cast<int>(pos - lineStart) + 1;
+			emit(Token::SYMBOL, pos + 1);
+			break;
+		case EMIT:
+			emit(state == NUMBER ? Token::INT_CONST : Token::IDENTIFIER, pos);
+			consume = false;
+			break;
+		case EMIT_STRING:
+			emit(Token::STRING_CONST, pos);
+			break;
+		case EMIT_SLASH:
+			emit(Token::SYMBOL, start + 1);
+			consume = false;
+			break;
+		case BAD_CHARACTER:
+			scanError = " at line " + to_string(line) + ", column " + to_string(pos - lineStart + 1) + ": Unexpected character '" + source[pos] + "'. Aborting.";
+			return;
+		case BAD_STRING:
+			scanError = " in string literal at line " + to_string(tokenLine) + ", column " + to_string(tokenColumn) + ", reached end of line without finding close quote ('\"'). Aborting.";
+			return;
+		case STOP:
+			return;
+		}
+		if (consume) {
+			if (charClass == NEWLINE) {
+				++line;
+				lineStart = pos + 1;
 			}
-			line.erase(longComment);
+			++pos;
 		}
+		state = transition.next;
 	}
-
-	// Trim left whitespace
-	size_t charsStart = line.find_first_not_of(" \t");
-	if (charsStart != string::npos)
-		line.erase(0, charsStart);
-	else { // entire line is whitespace
-		line.clear();
-		return isMultiLine;
-	}
-
-	// Trim right whitespace
-	size_t charsEnd = line.find_last_not_of(" \t");
-	if (charsEnd != string::npos)
-		line.erase(charsEnd + 1);
-
-	return isMultiLine;
 }
 
 bool JackTokenizer::hasMoreTokens()
 {
-	return strippedText.good();
+	return nextToken < tokens.size();
 }
 
 int JackTokenizer::currLineNum() {
-	for (auto it = lineNums.begin(); it != lineNums.end(); it++) {
-		if (strippedText.tellg() <= it->second) {
-			return (--it)->first;
-		}
-	}
-	return -1;
+	return curr.line;
 }
 
-bool JackTokenizer::aborted() {
-	return abortFlag;
+int JackTokenizer::currColumn() {
+	return curr.column;
 }
 
-void JackTokenizer::advanceWord() {
-	getline(strippedText, currWord, ' ');
+bool JackTokenizer::aborted() {
+	return abortFlag;
 }
 
 void JackTokenizer::advance()
 {
-	if (currWord.length() == 0) {
-		advanceWord();
+	if (nextToken < tokens.size()) {
+		curr = tokens[nextToken++];
+		currTokenMade = false;
+		return;
 	}
-
-	while (currWord == " ") {
-		cout << "Skipping lone space" << endl;
-		advanceWord();
+	if (!scanError.empty() && !abortFlag) {
+		cout << brightError << scanError << endl;
+		abortFlag = true;
 	}
+	curr = TokenSpan();
+	curr.offset = static_cast<uint32_t>(source.size());
+	curr.line = tokens.empty() ? 1 : tokens.back().line;
+	curr.column = tokens.empty() ? 1 : tokens.back().column + static_cast<int>(tokens.back().length);
+	currTokenMade = false;
+}
 
-	if (currWord.length() > 0 && symbols.find(currWord.at(0)) != symbols.end()) {
-		currTokenType = Token::SYMBOL;
-		currToken = currWord.at(0);
-		if (currWord.length() == 1)
-			advanceWord();
-		else {
-			currWord.erase(0,1);
-		}
-		return;
-	}
+string_view JackTokenizer::text()
+{
+	return source.substr(curr.offset, curr.length);
+}
 
-	regex nums("[0-9]+");
-	std::smatch m;
-	if (regex_search(currWord, m, nums) && m.prefix().length() == 0) { // only process "words" that start with a number
-		currTokenType = Token::INT_CONST;
-		currToken = m.str(); //shorthand for m[0].str()
-		if (m.suffix().length() == 0) {
-			advanceWord();
-		}
-		else currWord = m.suffix();
+void JackTokenizer::writeCurrToken(ostream& destination, bool jsonMode) {
+	if (curr.type == Token::NONE) return;
+	const char* name = tokenNames[static_cast<int>(curr.type)];
+	if (jsonMode) {
+		destination << "\"" << name << "\":";
+		if (curr.type != Token::INT_CONST) destination << "\"" << text() << "\"";
+		else destination << text();
+		destination << "," << endl;
 		return;
 	}
-	
-	regex stringexpr("\".*\"?"); // start quote, any character, followed by optional close quote.
-	string tempWord = currWord;
-	if (regex_match(currWord, m, stringexpr)) {
-		tempWord.erase(0, 1); // remove opening quote
-		size_t closeQuotePos = tempWord.find_first_of("\""); // ok to find first of since opening quote has been removed
-
-		while (closeQuotePos == string::npos) { 
-			if (!hasMoreTokens()) {
-				cout << brightError << " in string literal, reached end of file without finding close quote ('\"'). Aborting." << endl;
-				abortFlag = true;
-				return;
-			}
-			advanceWord();									
-			tempWord = tempWord + " " + currWord;
-			closeQuotePos = tempWord.find_first_of("\"");
-		}
-		currTokenType = Token::STRING_CONST;
-		if (closeQuotePos != tempWord.length() - 1) {
-			currWord = tempWord.substr(closeQuotePos + 1);
-			tempWord.erase(closeQuotePos);
-			currToken = tempWord;
-			return;
-		}
-		currToken = tempWord;
-		advanceWord();
-		return;
+	string_view tokenToWrite = text();
+	if (tokenToWrite == "<") {
+		tokenToWrite = "&lt;";
 	}
-
-	currTokenType = Token::IDENTIFIER;
-	size_t symbolSplit = currWord.find_first_of("{}()[].,;+-*/&|<>=~");
-	currToken = currWord.substr(0, symbolSplit);
-	if (symbolSplit != string::npos) {
-		currWord.erase(0, symbolSplit);
+	else if (tokenToWrite == ">") {
+		tokenToWrite = "&gt;";
+	}
+	else if (tokenToWrite == "\"") {
+		tokenToWrite = "&quot;";
 	}
-	else advanceWord();
-	auto keywordIt = keywordList.find(currToken);
-	if (keywordIt != keywordList.end()) {
-		currTokenType = Token::KEYWORD;
+	else if (tokenToWrite == "&") {
+		tokenToWrite = "&amp;";
 	}
+	destination << "<" << name << ">" << tokenToWrite << "</" << name << ">" << endl;
 }
 
 ofstream& JackTokenizer::getOutputFile()
@@ -227,42 +299,44 @@ ofstream& JackTokenizer::getOutputFile()
 
 Token JackTokenizer::tokenType()
 {
-	return currTokenType;
+	return curr.type;
 }
 
 Keyword JackTokenizer::keyword()
 {
-	auto key = keywordList.find(currToken);
-	if (key != keywordList.end()) {
-		return key->second;
-	}
-	return Keyword::NONE;
+	return curr.keyword;
 }
 
 char JackTokenizer::symbol()
 {
-	return currToken.at(0);
+	return curr.length ? source[curr.offset] : '\0';
 }
 
-std::string& JackTokenizer::identifier()
+const std::string& JackTokenizer::identifier()
 {
+	if (!currTokenMade) {
+		currToken.assign(text());
+		currTokenMade = true;
+	}
 	return currToken;
 }
 
 int JackTokenizer::intVal()
 {
-	return stoi(currToken);
+	int value = 0;
+	from_chars(source.data() + curr.offset, source.data() + curr.offset + curr.length, value);
+	return value;
 }
 
-std::string& JackTokenizer::stringVal()
+const std::string& JackTokenizer::stringVal()
 {
-	return currToken;
+	return identifier();
 }
 
 void JackTokenizer::close()
 {
-	if (inFile.is_open()) {
-		inFile.close();
+	if (isOpen) {
+		isOpen = false;
 		cout << "==============" << endl;
 	}
 }
@@ -274,4 +348,5 @@ bool JackTokenizer::didFailOpen()
 
 JackTokenizer::~JackTokenizer()
 {
+	if (mapping) munmap(mapping, mappingSize);
 }
@@ -1,42 +1,65 @@
 #pragma once
 #include "Shared.h"
 #include <string>
+#include <string_view>
 #include <fstream>
-#include <sstream>
-#include <map>
-#include <set>
+#include <ostream>
 #include <vector>
+#include <cstdint>
 
+// Splits a whole .jack file into tokens up front with a table-driven DFA: every byte is mapped
+// to a character class by a 256-entry table, and a transition table over (state, class) says
+// where to go next and whether a token starts or ends there. The file is mapped into memory and
+// tokens are spans of it with their line and column, so nothing is copied while scanning and a
+// diagnostic finds its position in O(1). advance() steps through the tokens.
+// Shared by the compiler, the Jack toolchain and the analyzer.
 class JackTokenizer
 {
 public:
 	JackTokenizer(const std::string& inputFilename);
+	JackTokenizer(const JackTokenizer&) = delete; // owns the mapping of the file
+	JackTokenizer& operator=(const JackTokenizer&) = delete;
 	bool hasMoreTokens();
 	void advance();
 	Token tokenType();
 	Keyword keyword();
 	char symbol();
-	std::string& identifier();
+	std::string_view text(); // the current token as it is in the source, without a string constant's quotes
+	const std::string& identifier(); // text() as a string, made on first use for each token
 	int intVal();
-	std::string& stringVal();
+	const std::string& stringVal();
 	int currLineNum();
+	int currColumn();
+	// Writes the current token as an XML element, or a JSON member, for the analyzer
+	void writeCurrToken(std::ostream& destination, bool jsonMode = false);
 	std::ofstream& getOutputFile();
 	void close();
 	bool didFailOpen();
 	bool aborted();
 	~JackTokenizer();
 private:
-	std::ifstream inFile;
+	struct TokenSpan {
+		Token type = Token::NONE;
+		Keyword keyword = Keyword::NONE;
+		uint32_t offset = 0; // into source; a string constant's span leaves out the quotes
+		uint32_t length = 0;
+		int line = 0;
+		int column = 0; // of the token's first character (a string constant's opening quote), from 1
+	};
+
 	std::ofstream outFile;
-	std::string currToken;
-	std::stringstream strippedText;
-	void advanceWord();
-	std::string currWord;
-	std::map<int, int> lineNums;
+	void* mapping = nullptr;  // the mapped file, or null when it was read into buffer
+	size_t mappingSize = 0;
+	std::string buffer;
+	std::string_view source;
+	std::vector<TokenSpan> tokens;
+	size_t nextToken = 0;
+	TokenSpan curr;
+	std::string currToken;    // identifier() of the current token, reusing its storage from token to token
+	bool currTokenMade = false;
+	std::string scanError;    // reported once advance() reaches the point where scanning stopped
 	bool abortFlag = false;
-	Token currTokenType = Token::NONE;
+	bool isOpen = false;
 	bool failedOpen = false;
-	void stripAllComments();
-	bool removeComments(std::string& line);
+	void scan();
 };
-
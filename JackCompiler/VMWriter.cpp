@@ -8,7 +8,7 @@ static const char* brightError = "\x1B[91mERROR\033[0m";
 static const char* segments[] = { "constant", "argument", "local", "static", "this", "that", "pointer", "temp", "none" };
 static const char* commands[] = { "add", "sub", "neg", "eq", "gt", "lt", "and", "or", "not" };
 
-VMWriter::VMWriter(const std::string& outputFilename)
+VMWriter::VMWriter(const std::string& outputFilename): out(outFile)
 {
 	outFile.open(outputFilename);
 	if (outFile.is_open()) {
@@ -20,57 +20,61 @@ VMWriter::VMWriter(const std::string& outputFilename)
 	}
 }
 
+VMWriter::VMWriter(): out(memory)
+{
+}
+
 void VMWriter::writePush(Segment segment, int index)
 {
-	outFile << "push " << segments[static_cast<int>(segment)] << " " << index << endl;
+	out << "push " << segments[static_cast<int>(segment)] << " " << index << endl;
 }
 
 void VMWriter::writePop(Segment segment, int index)
 {
-	outFile << "pop " << segments[static_cast<int>(segment)] << " " << index << endl;
+	out << "pop " << segments[static_cast<int>(segment)] << " " << index << endl;
 }
 
 void VMWriter::writeArithmetic(Command command)
 {
 	if (command == Command::MULT) {
-		outFile << "call Math.multiply 2" << endl;
+		out << "call Math.multiply 2" << endl;
 		return;
 	}
 	else if (command == Command::DIV) {
-		outFile << "call Math.divide 2" << endl;
+		out << "call Math.divide 2" << endl;
 		return;
 	}
-	outFile << commands[static_cast<int>(command)] << endl;
+	out << commands[static_cast<int>(command)] << endl;
 }
 
 void VMWriter::writeLabel(string_view label)
 {
-	outFile << "label " << label << endl;
+	out << "label " << label << endl;
 }
 
 void VMWriter::writeGoto(string_view label)
 {
-	outFile << "goto " << label << endl;
+	out << "goto " << label << endl;
 }
 
 void VMWriter::writeIf(string_view label)
 {
-	outFile << "if-goto " << label << endl;
+	out << "if-goto " << label << endl;
 }
 
 void VMWriter::writeCall(string_view name, int nArgs)
 {
-	outFile << "call " << name << " " << nArgs << endl;
+	out << "call " << name << " " << nArgs << endl;
 }
 
 void VMWriter::writeFunction(string_view name, int nLocals)
 {
-	outFile << "function " << name << " " << nLocals << endl;
+	out << "function " << name << " " << nLocals << endl;
 }
 
 void VMWriter::writeReturn()
 {
-	outFile << "return" << endl;
+	out << "return" << endl;
 }
 
 bool VMWriter::didFailOpen()
@@ -86,6 +90,13 @@ void VMWriter::close()
 	}
 }
 
+string VMWriter::takeOutput()
+{
+	string output = std::move(memory).str();
+	memory.str(string());
+	return output;
+}
+
 VMWriter::~VMWriter()
 {
 }
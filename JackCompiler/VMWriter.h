@@ -1,26 +1,32 @@
 #pragma once
 #include "Shared.h"
 #include <string>
+#include <string_view>
 #include <fstream>
+#include <sstream>
 
 class VMWriter
 {
 public:
 	VMWriter(const std::string& outputFilename);
+	VMWriter(); // keeps the code in memory, read with takeOutput()
 	void writePush(Segment segment, int index);
 	void writePop(Segment segment, int index);
 	void writeArithmetic(Command command);
-	void writeLabel(const std::string& label);
-	void writeGoto(const std::string& label);
-	void writeIf(const std::string& label);
-	void writeCall(const std::string& name, int nArgs);
-	void writeFunction(const std::string& name, int nLocals);
+	void writeLabel(std::string_view label);
+	void writeGoto(std::string_view label);
+	void writeIf(std::string_view label);
+	void writeCall(std::string_view name, int nArgs);
+	void writeFunction(std::string_view name, int nLocals);
 	void writeReturn();
 	bool didFailOpen();
 	void close();
+	std::string takeOutput();
 	~VMWriter();
 private:
 	std::ofstream outFile;
+	std::ostringstream memory;
+	std::ostream& out;
 	bool failedOpen = false;
 };
 
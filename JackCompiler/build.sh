@@ -0,0 +1,3 @@
+#!/bin/bash
+# The build cache is the VM translator's, shared rather than copied
+g++ -std=c++2a -O2 *.cpp "../VM translator/BuildCache.cpp" -o JackCompiler.o
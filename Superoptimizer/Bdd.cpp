@@ -0,0 +1,85 @@
+#include "Bdd.h"
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+// Node ids and variables are packed into the table keys
+static constexpr int NODE_BITS = 21;
+static constexpr int TERMINAL = INT_MAX; // the variable of the two terminals, after every real one
+
+Bdd::Bdd(int maxNodes): maxNodes(min(maxNodes, 1 << NODE_BITS))
+{
+	nodes.push_back({ TERMINAL, FALSE, FALSE });
+	nodes.push_back({ TERMINAL, TRUE, TRUE });
+}
+
+bool Bdd::overflowed() const
+{
+	return overflow;
+}
+
+int Bdd::make(int var, int low, int high)
+{
+	if (low == high) return low;
+	const uint64_t key = (static_cast<uint64_t>(var) << (2 * NODE_BITS)) | (static_cast<uint64_t>(low) << NODE_BITS) | static_cast<uint64_t>(high);
+	auto it = unique.find(key);
+	if (it != unique.end()) return it->second;
+	if (static_cast<int>(nodes.size()) >= maxNodes) {
+		overflow = true;
+		return FALSE;
+	}
+	nodes.push_back({ var, low, high });
+	unique.emplace(key, static_cast<int>(nodes.size()) - 1);
+	return static_cast<int>(nodes.size()) - 1;
+}
+
+int Bdd::variable(int index)
+{
+	return make(index, FALSE, TRUE);
+}
+
+int Bdd::cofactor(int f, int var, bool value) const
+{
+	if (nodes[f].var != var) return f;
+	return value ? nodes[f].high : nodes[f].low;
+}
+
+int Bdd::ite(int f, int g, int h)
+{
+	if (f == TRUE) return g;
+	if (f == FALSE) return h;
+	if (g == h) return g;
+	if (g == TRUE && h == FALSE) return f;
+
+	const uint64_t key = (static_cast<uint64_t>(f) << (2 * NODE_BITS)) | (static_cast<uint64_t>(g) << NODE_BITS) | static_cast<uint64_t>(h);
+	auto it = computed.find(key);
+	if (it != computed.end()) return it->second;
+
+	const int var = min({ nodes[f].var, nodes[g].var, nodes[h].var });
+	const int high = ite(cofactor(f, var, true), cofactor(g, var, true), cofactor(h, var, true));
+	const int low = ite(cofactor(f, var, false), cofactor(g, var, false), cofactor(h, var, false));
+	const int result = make(var, low, high);
+	computed.emplace(key, result);
+	return result;
+}
+
+int Bdd::negate(int f)
+{
+	return ite(f, FALSE, TRUE);
+}
+
+int Bdd::both(int f, int g)
+{
+	return ite(f, g, FALSE);
+}
+
+int Bdd::either(int f, int g)
+{
+	return ite(f, TRUE, g);
+}
+
+int Bdd::differ(int f, int g)
+{
+	return ite(f, negate(g), g);
+}
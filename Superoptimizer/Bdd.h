@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Reduced ordered binary decision diagrams, just enough to decide whether two Hack sequences
+// compute the same bits for every input. A function is a node id, and equal functions get the
+// same id, so a formula is valid exactly when it comes out as TRUE. Nodes are never freed; one
+// Bdd serves one check and stops growing at maxNodes, after which its results mean nothing.
+class Bdd
+{
+public:
+	static constexpr int FALSE = 0;
+	static constexpr int TRUE = 1;
+	static constexpr int MAX_VARIABLES = 2048;
+
+	Bdd(int maxNodes);
+	int variable(int index); // smaller indices are tested first
+	int ite(int f, int g, int h); // if f then g else h
+	int negate(int f);
+	int both(int f, int g);
+	int either(int f, int g);
+	int differ(int f, int g);
+	bool overflowed() const;
+
+private:
+	struct Node {
+		int var;
+		int low;  // the function when var is 0
+		int high; // and when it is 1
+	};
+
+	std::vector<Node> nodes;
+	std::unordered_map<uint64_t, int> unique;   // by (var, low, high)
+	std::unordered_map<uint64_t, int> computed; // ite results by (f, g, h)
+	int maxNodes;
+	bool overflow = false;
+
+	int make(int var, int low, int high);
+	int cofactor(int f, int var, bool value) const;
+};
@@ -0,0 +1,100 @@
+// HackSuperoptimizer.cpp : This file contains the 'main' function. Program execution begins and ends there.
+//
+// Reads the .asm files it is given (or every .asm in the directories it is given) and writes a
+// table of shorter equivalents for their most frequent instruction sequences, which the VM
+// translator and the assembler apply with -rules.
+
+#include "Superoptimizer.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    vector<string> inputs;
+    int maxLength = 4;            // -length: longest sequence searched
+    long long minCount = 8;       // -min-count: rarer sequences are not searched
+    int maxTargets = 2000;        // -max-targets: most sequences searched
+    string rulesName = "peephole.rules";
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "-length" && i + 1 < argc) {
+            maxLength = stoi(argv[++i]);
+        }
+        else if (arg == "-min-count" && i + 1 < argc) {
+            minCount = std::max(1ll, stoll(argv[++i]));
+        }
+        else if (arg == "-max-targets" && i + 1 < argc) {
+            maxTargets = std::max(1, stoi(argv[++i]));
+        }
+        else if (arg == "-o" && i + 1 < argc) {
+            rulesName = argv[++i];
+        }
+        else {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty()) {
+        cout << "Enter .asm filename or directory: ";
+        string input;
+        cin >> input;
+        inputs.push_back(input);
+    }
+
+    auto start = chrono::high_resolution_clock::now();
+    Superoptimizer superoptimizer(maxLength);
+    int numFiles = 0;
+    for (auto& input : inputs) {
+        vector<filesystem::path> files;
+        if (filesystem::is_directory(input)) {
+            for (auto& p : filesystem::directory_iterator(input)) {
+                if (p.path().extension() == ".asm") files.push_back(p.path());
+            }
+            std::sort(files.begin(), files.end());
+        }
+        else {
+            files.push_back(input);
+        }
+        for (auto& file : files) {
+            if (!superoptimizer.addFile(file.string())) {
+                return -1;
+            }
+            ++numFiles;
+        }
+    }
+    cout << "Counted " << superoptimizer.numWindows() << " distinct sequences of up to " << maxLength << " instructions in " << numFiles << " files." << endl;
+
+    vector<Superoptimizer::Rule> rules = superoptimizer.search(minCount, maxTargets);
+
+    ofstream rulesFile(rulesName);
+    if (!rulesFile.is_open()) {
+        cout << "Error opening " << rulesName << " for the rules." << endl;
+        return -1;
+    }
+    rulesFile << "# Hack peephole rules: occurrences | pattern | shorter equivalent\n"
+        << "# $0, $1... stand for any symbol. Generated by HackSuperoptimizer from";
+    for (auto& input : inputs) rulesFile << " " << filesystem::path(input).filename().string();
+    rulesFile << " (sequences of up to " << maxLength << " instructions)\n"
+        << "# Every rule is proved equivalent for all values of A, D, the symbols and memory\n";
+    long long saved = 0;
+    for (auto& rule : rules) {
+        rulesFile << rule.occurrences << " | " << rule.pattern << " | " << rule.replacement << "\n";
+        saved += rule.occurrences * (std::count(rule.pattern.begin(), rule.pattern.end(), ' ') + 1
+            - (rule.replacement.empty() ? 0 : std::count(rule.replacement.begin(), rule.replacement.end(), ' ') + 1));
+    }
+
+    auto stop = chrono::high_resolution_clock::now();
+    auto duration = chrono::duration_cast<chrono::milliseconds>(stop - start);
+    if (superoptimizer.numUnproved() > 0) {
+        cout << superoptimizer.numUnproved() << " candidates passed the tests but could not be proved, and were left out." << endl;
+    }
+    cout << "Wrote " << rules.size() << " rules to " << rulesName << ", saving up to " << saved << " instructions on the input, in " << duration.count() << "ms." << endl;
+    return 0;
+}
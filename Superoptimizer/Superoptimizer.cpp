@@ -0,0 +1,516 @@
+#include "Superoptimizer.h"
+#include "Bdd.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <array>
+
+using namespace std;
+
+static constexpr int MAX_LENGTH = 8;
+static constexpr int QUICK_TESTS = 64;    // every candidate that survives the first state
+static constexpr int VERIFY_TESTS = 4096; // a candidate that passes the quick tests
+static constexpr int MAX_WORDS = 64;        // symbolic words in one proof
+static constexpr int MAX_PROOF_NODES = 1 << 20;
+
+// The 28 computations of the Hack ALU, as the a-bit followed by c1..c6
+static const vector<pair<string_view, uint8_t>> comps = {
+	{ "0", 0b0101010 }, { "1", 0b0111111 }, { "-1", 0b0111010 }, { "D", 0b0001100 }, { "A", 0b0110000 },
+	{ "!D", 0b0001101 }, { "!A", 0b0110001 }, { "-D", 0b0001111 }, { "-A", 0b0110011 }, { "D+1", 0b0011111 },
+	{ "A+1", 0b0110111 }, { "D-1", 0b0001110 }, { "A-1", 0b0110010 }, { "D+A", 0b0000010 }, { "D-A", 0b0010011 },
+	{ "A-D", 0b0000111 }, { "D&A", 0b0000000 }, { "D|A", 0b0010101 }, { "M", 0b1110000 }, { "!M", 0b1110001 },
+	{ "-M", 0b1110011 }, { "M+1", 0b1110111 }, { "M-1", 0b1110010 }, { "D+M", 0b1000010 }, { "D-M", 0b1010011 },
+	{ "M-D", 0b1000111 }, { "D&M", 0b1000000 }, { "D|M", 0b1010101 }
+};
+// Operand orders the translator also writes
+static const map<string_view, uint8_t> compAliases = {
+	{ "A+D", 0b0000010 }, { "M+D", 0b1000010 }, { "A&D", 0b0000000 }, { "M&D", 0b1000000 }, { "A|D", 0b0010101 }, { "M|D", 0b1010101 }
+};
+static const char* destNames[] = { "", "M", "D", "MD", "A", "AM", "AD", "AMD" };
+
+static const map<string_view, uint16_t> predefined = {
+	{ "SP", 0 }, { "LCL", 1 }, { "ARG", 2 }, { "THIS", 3 }, { "THAT", 4 },
+	{ "R0", 0 }, { "R1", 1 }, { "R2", 2 }, { "R3", 3 }, { "R4", 4 }, { "R5", 5 }, { "R6", 6 }, { "R7", 7 },
+	{ "R8", 8 }, { "R9", 9 }, { "R10", 10 }, { "R11", 11 }, { "R12", 12 }, { "R13", 13 }, { "R14", 14 }, { "R15", 15 },
+	{ "SCREEN", 16384 }, { "KBD", 24576 }
+};
+
+static bool isLiteral(string_view operand)
+{
+	return predefined.count(operand) || all_of(operand.begin(), operand.end(), ::isdigit);
+}
+
+static uint16_t literalValue(const string& operand)
+{
+	auto it = predefined.find(operand);
+	return it != predefined.end() ? it->second : static_cast<uint16_t>(stoi(operand));
+}
+
+// A machine state to run candidates on: registers, the operands' values and the initial
+// memory, which is a hash of the address picking from a pool of likely values (including the
+// operands themselves), so pointers in memory alias symbols and each other
+struct TestCase {
+	uint16_t a = 0, d = 0;
+	uint64_t seed = 0;
+	uint16_t values[MAX_LENGTH] = {};
+	vector<uint16_t> pool;
+	uint16_t initial(uint16_t address) const {
+		uint64_t h = (seed ^ (address * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+		h ^= h >> 31;
+		return (h & 3) ? pool[(h >> 8) % pool.size()] : static_cast<uint16_t>(h >> 16);
+	}
+};
+
+struct Superoptimizer::Machine {
+	uint16_t a = 0, d = 0;
+	int numWrites = 0;
+	uint16_t addresses[MAX_LENGTH] = {}, values[MAX_LENGTH] = {};
+
+	uint16_t read(const TestCase& test, uint16_t address) const {
+		for (int i = 0; i < numWrites; ++i) {
+			if (addresses[i] == address) return values[i];
+		}
+		return test.initial(address);
+	}
+	void write(uint16_t address, uint16_t value) {
+		for (int i = 0; i < numWrites; ++i) {
+			if (addresses[i] == address) {
+				values[i] = value;
+				return;
+			}
+		}
+		addresses[numWrites] = address;
+		values[numWrites++] = value;
+	}
+	void step(const TestCase& test, const Instruction& instruction) {
+		if (instruction.isA) {
+			a = test.values[instruction.operand];
+			return;
+		}
+		const uint8_t comp = instruction.comp;
+		uint16_t x = d, y = (comp & 0b1000000) ? read(test, a) : a;
+		if (comp & 0b100000) x = 0;
+		if (comp & 0b010000) x = ~x;
+		if (comp & 0b001000) y = 0;
+		if (comp & 0b000100) y = ~y;
+		uint16_t out = (comp & 0b10) ? static_cast<uint16_t>(x + y) : static_cast<uint16_t>(x & y);
+		if (comp & 0b1) out = ~out;
+		const uint16_t address = a;
+		if (instruction.dest & 1) write(address, out);
+		if (instruction.dest & 4) a = out;
+		if (instruction.dest & 2) d = out;
+	}
+	// Same registers and the same contents wherever either machine wrote
+	bool matches(const TestCase& test, const Machine& other) const {
+		if (a != other.a || d != other.d) return false;
+		for (int i = 0; i < numWrites; ++i) {
+			if (other.read(test, addresses[i]) != values[i]) return false;
+		}
+		for (int i = 0; i < other.numWrites; ++i) {
+			if (read(test, other.addresses[i]) != other.values[i]) return false;
+		}
+		return true;
+	}
+};
+
+// Runs both sequences on symbolic words, one BDD per bit, to prove what the tests suggest. A, D,
+// the symbols and every memory word read before it is written are variables, so a candidate
+// that passes is equivalent on every machine state. Initial memory is one variable word per
+// distinct address expression, with the assumption that equal addresses hold equal values.
+struct Superoptimizer::Prover {
+	using Word = array<int, 16>; // least significant bit first
+	struct State {
+		Word a, d;
+		vector<pair<Word, Word>> writes; // address, value, oldest first
+	};
+
+	Bdd bdd{ MAX_PROOF_NODES };
+	int numWords = 0;
+	bool tooLarge = false;
+	vector<pair<Word, Word>> initialReads;
+	int assumptions = Bdd::TRUE;
+
+	// Bits of equal significance are next to each other in the order, which keeps adders small
+	Word fresh() {
+		Word word;
+		if (numWords == MAX_WORDS) {
+			tooLarge = true;
+			word.fill(Bdd::FALSE);
+			return word;
+		}
+		for (int bit = 0; bit < 16; ++bit) word[bit] = bdd.variable(bit * MAX_WORDS + numWords);
+		++numWords;
+		return word;
+	}
+	static Word constant(uint16_t value) {
+		Word word;
+		for (int bit = 0; bit < 16; ++bit) word[bit] = ((value >> bit) & 1) ? Bdd::TRUE : Bdd::FALSE;
+		return word;
+	}
+	int equal(const Word& x, const Word& y) {
+		int result = Bdd::TRUE;
+		for (int bit = 0; bit < 16; ++bit) result = bdd.both(result, bdd.negate(bdd.differ(x[bit], y[bit])));
+		return result;
+	}
+	Word select(int condition, const Word& x, const Word& y) {
+		Word word;
+		for (int bit = 0; bit < 16; ++bit) word[bit] = bdd.ite(condition, x[bit], y[bit]);
+		return word;
+	}
+	Word readInitial(const Word& address) {
+		for (auto& [known, value] : initialReads) {
+			if (known == address) return value;
+		}
+		Word value = fresh();
+		for (auto& [known, knownValue] : initialReads) {
+			assumptions = bdd.both(assumptions, bdd.either(bdd.negate(equal(address, known)), equal(value, knownValue)));
+		}
+		initialReads.emplace_back(address, value);
+		return value;
+	}
+	Word read(const State& state, const Word& address) {
+		Word value = readInitial(address);
+		for (auto& [written, writtenValue] : state.writes) {
+			value = select(equal(address, written), writtenValue, value);
+		}
+		return value;
+	}
+	// The same ALU as Machine::step, bit by bit
+	void step(State& state, const Word* operands, const Instruction& instruction) {
+		if (instruction.isA) {
+			state.a = operands[instruction.operand];
+			return;
+		}
+		const uint8_t comp = instruction.comp;
+		Word x = state.d, y = (comp & 0b1000000) ? read(state, state.a) : state.a;
+		Word out;
+		int carry = Bdd::FALSE;
+		for (int bit = 0; bit < 16; ++bit) {
+			int xb = (comp & 0b100000) ? Bdd::FALSE : x[bit];
+			if (comp & 0b010000) xb = bdd.negate(xb);
+			int yb = (comp & 0b001000) ? Bdd::FALSE : y[bit];
+			if (comp & 0b000100) yb = bdd.negate(yb);
+			if (comp & 0b10) {
+				out[bit] = bdd.differ(bdd.differ(xb, yb), carry);
+				carry = bdd.ite(xb, bdd.either(yb, carry), bdd.both(yb, carry));
+			}
+			else {
+				out[bit] = bdd.both(xb, yb);
+			}
+			if (comp & 0b1) out[bit] = bdd.negate(out[bit]);
+		}
+		const Word address = state.a;
+		if (instruction.dest & 1) state.writes.emplace_back(address, out);
+		if (instruction.dest & 4) state.a = out;
+		if (instruction.dest & 2) state.d = out;
+	}
+	bool proves(const vector<string>& operandNames, const vector<Instruction>& target, const vector<Instruction>& candidate) {
+		Word operands[MAX_LENGTH];
+		for (size_t k = 0; k < operandNames.size(); ++k) {
+			operands[k] = isLiteral(operandNames[k]) ? constant(literalValue(operandNames[k])) : fresh();
+		}
+		State start{ fresh(), fresh(), {} };
+		State expected = start, actual = start;
+		for (auto& instruction : target) step(expected, operands, instruction);
+		for (auto& instruction : candidate) step(actual, operands, instruction);
+
+		// Memory only differs where one of them wrote
+		int same = bdd.both(equal(expected.a, actual.a), equal(expected.d, actual.d));
+		for (const State* state : { &expected, &actual }) {
+			for (auto& write : state->writes) {
+				same = bdd.both(same, equal(read(expected, write.first), read(actual, write.first)));
+			}
+		}
+		return bdd.either(bdd.negate(assumptions), same) == Bdd::TRUE && !bdd.overflowed() && !tooLarge;
+	}
+};
+
+Superoptimizer::Superoptimizer(int maxLength): maxLength(std::clamp(maxLength, 2, MAX_LENGTH))
+{
+}
+
+bool Superoptimizer::parse(string_view text, Window& window)
+{
+	size_t start = 0;
+	while (start < text.size()) {
+		size_t end = text.find(' ', start);
+		if (end == string_view::npos) end = text.size();
+		string_view line = text.substr(start, end - start);
+		start = end + 1;
+
+		Instruction instruction;
+		if (line[0] == '@') {
+			string operand(line.substr(1));
+			auto it = find(window.operands.begin(), window.operands.end(), operand);
+			instruction.isA = true;
+			instruction.operand = static_cast<int>(it - window.operands.begin());
+			if (it == window.operands.end()) window.operands.push_back(operand);
+		}
+		else {
+			size_t equals = line.find('=');
+			if (equals == string_view::npos || line.find(';') != string_view::npos) return false;
+			string_view comp = line.substr(equals + 1);
+			for (char c : line.substr(0, equals)) instruction.dest |= (c == 'A' ? 4 : c == 'D' ? 2 : c == 'M' ? 1 : 0);
+			auto it = find_if(comps.begin(), comps.end(), [&](auto& entry) { return entry.first == comp; });
+			if (it != comps.end()) instruction.comp = it->second;
+			else if (auto alias = compAliases.find(comp); alias != compAliases.end()) instruction.comp = alias->second;
+			else return false;
+		}
+		window.code.push_back(instruction);
+	}
+	return true;
+}
+
+string Superoptimizer::format(const Window& window, const vector<Instruction>& code)
+{
+	string text;
+	for (auto& instruction : code) {
+		if (!text.empty()) text += ' ';
+		if (instruction.isA) {
+			text += "@" + window.operands[instruction.operand];
+			continue;
+		}
+		auto it = find_if(comps.begin(), comps.end(), [&](auto& entry) { return entry.second == instruction.comp; });
+		text += string(destNames[instruction.dest]) + "=" + string(it->first);
+	}
+	return text;
+}
+
+bool Superoptimizer::addFile(const string& filename)
+{
+	ifstream file(filename);
+	if (!file.is_open()) {
+		cout << "Error opening " << filename << endl;
+		return false;
+	}
+	// Comments are skipped, labels and jumps end a run of straight-line code
+	vector<string> run;
+	string line;
+	while (getline(file, line)) {
+		line = line.substr(0, line.find("//"));
+		line.erase(remove_if(line.begin(), line.end(), ::isspace), line.end());
+		if (line.empty()) continue;
+		if (line[0] == '(' || line.find(';') != string::npos) {
+			run.clear();
+			continue;
+		}
+		run.push_back(line);
+		for (int length = 2; length <= maxLength && length <= static_cast<int>(run.size()); ++length) {
+			// Symbols are numbered in order of appearance, so windows that differ only in
+			// which variable or label they use count as one
+			vector<string> symbols;
+			string key;
+			for (size_t i = run.size() - length; i < run.size(); ++i) {
+				if (!key.empty()) key += ' ';
+				string_view operand = string_view(run[i]).substr(1);
+				if (run[i][0] != '@' || isLiteral(operand)) {
+					key += run[i];
+					continue;
+				}
+				auto it = find(symbols.begin(), symbols.end(), operand);
+				if (it == symbols.end()) it = symbols.insert(symbols.end(), string(operand));
+				key += "@$" + to_string(it - symbols.begin());
+			}
+			++windowCounts[key];
+		}
+	}
+	return true;
+}
+
+int Superoptimizer::numWindows() const
+{
+	return static_cast<int>(windowCounts.size());
+}
+
+int Superoptimizer::numUnproved() const
+{
+	return unproved;
+}
+
+static vector<TestCase> makeTests(const vector<string>& operands, int count, uint64_t seed)
+{
+	mt19937_64 random(seed);
+	vector<TestCase> tests(count);
+	for (auto& test : tests) {
+		test.pool = { 0, 1, 2, 3, 4, 5, 13, 14, 15, 16, 17, 255, 256, 257, 0x7FFF, 0x8000, 0xFFFF };
+		for (size_t i = 0; i < operands.size(); ++i) {
+			const string& operand = operands[i];
+			if (isLiteral(operand)) {
+				test.values[i] = literalValue(operand);
+			}
+			else if (i > 0 && random() % 4 == 0) {
+				test.values[i] = test.values[random() % i]; // two symbols at one address
+			}
+			else {
+				test.values[i] = random() % 2 ? test.pool[random() % test.pool.size()] : static_cast<uint16_t>(random());
+			}
+			test.pool.push_back(test.values[i]);
+			test.pool.push_back(test.values[i] + 1);
+			test.pool.push_back(test.values[i] - 1);
+		}
+		test.a = test.pool[random() % test.pool.size()];
+		test.d = random() % 2 ? test.pool[random() % test.pool.size()] : static_cast<uint16_t>(random());
+		test.seed = random();
+	}
+	return tests;
+}
+
+bool Superoptimizer::findShorter(const Window& target, vector<Instruction>& best) const
+{
+	const int numOperands = static_cast<int>(target.operands.size());
+	vector<TestCase> quick = makeTests(target.operands, QUICK_TESTS, 1);
+	auto runAll = [](const TestCase& test, const vector<Instruction>& code) {
+		Machine machine;
+		machine.a = test.a;
+		machine.d = test.d;
+		for (auto& instruction : code) machine.step(test, instruction);
+		return machine;
+	};
+	vector<Machine> expected;
+	for (auto& test : quick) expected.push_back(runAll(test, target.code));
+
+	vector<Instruction> alphabet;
+	for (int k = 0; k < numOperands; ++k) {
+		Instruction load;
+		load.isA = true;
+		load.operand = k;
+		alphabet.push_back(load);
+	}
+	for (auto& [name, comp] : comps) {
+		for (uint8_t dest = 1; dest < 8; ++dest) {
+			Instruction compute;
+			compute.comp = comp;
+			compute.dest = dest;
+			alphabet.push_back(compute);
+		}
+	}
+
+	auto isEquivalent = [&](const vector<Instruction>& code) {
+		for (size_t t = 1; t < quick.size(); ++t) {
+			if (!runAll(quick[t], code).matches(quick[t], expected[t])) return false;
+		}
+		for (auto& test : makeTests(target.operands, VERIFY_TESTS, 2)) {
+			if (!runAll(test, code).matches(test, runAll(test, target.code))) return false;
+		}
+		// The tests only rule candidates out; a rule is written once it is proved
+		Prover prover;
+		if (!prover.proves(target.operands, target.code, code)) {
+			++unproved;
+			return false;
+		}
+		return true;
+	};
+
+	// Shortest first, so the first equivalent found is optimal. Candidates are run on the
+	// first test state as they are built, one instruction per level.
+	vector<Instruction> candidate;
+	vector<Machine> states;
+	bool found = false;
+	auto extend = [&](auto& self, int remaining) -> void {
+		if (found) return;
+		if (remaining == 0) {
+			if (states.back().matches(quick[0], expected[0]) && isEquivalent(candidate)) {
+				best = candidate;
+				found = true;
+			}
+			return;
+		}
+		for (auto& instruction : alphabet) {
+			// An A-instruction straight after another one makes the first dead, and a shorter
+			// sequence without it has been tried already
+			if (instruction.isA && !candidate.empty() && candidate.back().isA) continue;
+			candidate.push_back(instruction);
+			Machine next = states.back();
+			next.step(quick[0], instruction);
+			states.push_back(next);
+			self(self, remaining - 1);
+			states.pop_back();
+			candidate.pop_back();
+			if (found) return;
+		}
+	};
+	Machine start;
+	start.a = quick[0].a;
+	start.d = quick[0].d;
+	for (int length = 0; length < static_cast<int>(target.code.size()) && !found; ++length) {
+		states.assign(1, start);
+		extend(extend, length);
+	}
+	return found;
+}
+
+// Whether the window contains the pattern of a rule that was found already, so the rule
+// will have rewritten it before this one could match
+static bool containsRule(const vector<string>& window, const vector<vector<string>>& patterns)
+{
+	for (auto& pattern : patterns) {
+		for (size_t start = 0; start + pattern.size() <= window.size(); ++start) {
+			map<string, string> bound;
+			bool match = true;
+			for (size_t i = 0; i < pattern.size() && match; ++i) {
+				const string& line = window[start + i];
+				if (pattern[i].rfind("@$", 0) == 0 && line[0] == '@') {
+					auto [it, isNew] = bound.try_emplace(pattern[i], line);
+					match = isNew || it->second == line;
+				}
+				else {
+					match = (pattern[i] == line);
+				}
+			}
+			if (match) return true;
+		}
+	}
+	return false;
+}
+
+static vector<string> split(const string& text)
+{
+	vector<string> lines;
+	size_t start = 0;
+	while (start < text.size()) {
+		size_t end = text.find(' ', start);
+		if (end == string::npos) end = text.size();
+		lines.push_back(text.substr(start, end - start));
+		start = end + 1;
+	}
+	return lines;
+}
+
+vector<Superoptimizer::Rule> Superoptimizer::search(long long minCount, int maxTargets)
+{
+	vector<pair<long long, string>> targets;
+	for (auto& [key, count] : windowCounts) {
+		if (count >= minCount) targets.emplace_back(count, key);
+	}
+	// Most frequent first; a shorter window before the longer ones that contain it
+	stable_sort(targets.begin(), targets.end(), [](auto& a, auto& b) {
+		return a.first != b.first ? a.first > b.first : a.second.size() < b.second.size();
+	});
+	if (static_cast<int>(targets.size()) > maxTargets) targets.resize(maxTargets);
+
+	vector<Rule> rules;
+	vector<vector<string>> patterns;
+	int searched = 0;
+	for (auto& [count, key] : targets) {
+		++searched;
+		Window window;
+		vector<string> lines = split(key);
+		if (!parse(key, window) || containsRule(lines, patterns)) continue;
+		auto start = chrono::high_resolution_clock::now();
+		vector<Instruction> shorter;
+		if (findShorter(window, shorter)) {
+			Rule rule;
+			rule.occurrences = count;
+			rule.pattern = key;
+			rule.replacement = format(window, shorter);
+			rules.push_back(rule);
+			patterns.push_back(lines);
+			auto stop = chrono::high_resolution_clock::now();
+			cout << "[" << searched << "/" << targets.size() << "] " << key << "  =>  " << (rule.replacement.empty() ? "(nothing)" : rule.replacement)
+				<< "  (" << count << " times, " << chrono::duration_cast<chrono::milliseconds>(stop - start).count() << "ms)" << endl;
+		}
+	}
+	return rules;
+}
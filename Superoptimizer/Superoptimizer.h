@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+// Finds shorter equivalents of the straight-line Hack sequences that occur in real assembly.
+// Windows of up to maxLength instructions are counted over the input. For each frequent one,
+// every sequence of fewer instructions (over all C-instructions and the window's own
+// A-instructions) is tried. A candidate must leave A, D and every memory word either sequence
+// writes exactly as the window does. Random machine states with aliasing between pointers,
+// symbols and the predefined registers rule out most candidates quickly; a candidate that
+// passes them is then proved symbolically for every state before it becomes a rule.
+class Superoptimizer
+{
+public:
+	struct Rule {
+		long long occurrences = 0;
+		std::string pattern;     // instructions separated by spaces, $0, $1... for symbol operands
+		std::string replacement; // empty when the pattern does nothing at all
+	};
+
+	Superoptimizer(int maxLength);
+	// Counts the windows of an assembly file, false if it cannot be read
+	bool addFile(const std::string& filename);
+	int numWindows() const;
+	// Candidates that passed every test but could not be proved, so no rule was written
+	int numUnproved() const;
+	// Searches the windows that occur at least minCount times, most frequent first
+	std::vector<Rule> search(long long minCount, int maxTargets);
+
+private:
+	struct Instruction {
+		bool isA = false;
+		int operand = 0; // index into the window's operands
+		uint8_t comp = 0, dest = 0;
+	};
+	struct Window {
+		std::vector<Instruction> code;
+		std::vector<std::string> operands; // literal text, or $k for a symbol
+	};
+	struct Machine; // a test state, see Superoptimizer.cpp
+	struct Prover;  // symbolic execution over BDDs, see Superoptimizer.cpp
+
+	int maxLength;
+	std::map<std::string, long long> windowCounts; // by canonical text
+	mutable int unproved = 0;
+
+	static bool parse(std::string_view text, Window& window);
+	static std::string format(const Window& window, const std::vector<Instruction>& code);
+	bool findShorter(const Window& target, std::vector<Instruction>& best) const;
+};
@@ -0,0 +1,2 @@
+#!/bin/bash
+g++ -std=c++2a -O2 *.cpp -o HackSuperoptimizer.o
@@ -0,0 +1,124 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <charconv>
+#include "HackObject.h"
+
+// Growable buffer the generated assembly is appended to. Literals are copied in place and
+// integers are formatted straight into it, so emitting a command allocates nothing once
+// the buffer has grown to size. The owner writes the contents out in one go.
+//
+// An encoding buffer keeps no text: each line is encoded into Hack words as soon as it is
+// complete, labels become symbols and symbolic A-instructions relocations (see ObjectSection),
+// so the program is never held as assembly and parsed again.
+class AsmBuffer
+{
+public:
+	AsmBuffer& operator<<(std::string_view text) {
+		if (!encode) {
+			data.append(text);
+			return *this;
+		}
+		for (size_t newline = text.find('\n'); newline != std::string_view::npos; newline = text.find('\n')) {
+			if (data.empty() && !inComment) encodeLine(text.substr(0, newline)); // a whole line, no need to copy it
+			else {
+				append(text.substr(0, newline));
+				endLine();
+			}
+			text.remove_prefix(newline + 1);
+		}
+		append(text);
+		return *this;
+	}
+	AsmBuffer& operator<<(char c) {
+		if (encode && c == '\n') endLine();
+		else append(std::string_view(&c, 1));
+		return *this;
+	}
+	AsmBuffer& operator<<(int value) {
+		if (inComment) return *this;
+		char digits[12];
+		auto result = std::to_chars(digits, digits + sizeof(digits), value);
+		data.append(digits, result.ptr - digits);
+		return *this;
+	}
+	AsmBuffer& operator<<(const AsmBuffer& other) {
+		if (encode) code.append(other.code);
+		else data.append(other.data);
+		valid = valid && other.valid;
+		return *this;
+	}
+	AsmBuffer& operator<<(AsmBuffer&& other) {
+		// Text is taken over when this buffer is empty and has not reserved more room,
+		// otherwise it is copied onto the end
+		if (encode) code.append(std::move(other.code));
+		else if (data.empty() && other.data.capacity() >= data.capacity()) data.swap(other.data);
+		else data.append(other.data);
+		valid = valid && other.valid;
+		return *this;
+	}
+
+	// Only while the buffer is empty
+	void setEncoding(bool enabled) { encode = enabled; }
+	bool encoding() const { return encode; }
+
+	void reserve(size_t size) { // in bytes of assembly, an instruction line is about 8 of them
+		if (encode) code.code.reserve(size / 8);
+		else data.reserve(size);
+	}
+	void clear() {
+		data.clear();
+		inComment = false;
+		code = ObjectSection();
+		valid = true;
+	}
+	size_t size() const { return encode ? code.code.size() : data.size(); }
+	int instructionCount() const { // lines that are neither labels nor comments
+		if (encode) return static_cast<int>(code.code.size());
+		int count = 0;
+		bool lineStart = true;
+		for (char c : data) {
+			if (lineStart && c != '(' && c != '/' && c != '\n') ++count;
+			lineStart = (c == '\n');
+		}
+		return count;
+	}
+	const char* begin() const { return data.data(); }
+	std::string_view view() const { return data; } // the assembly, empty while encoding
+	const ObjectSection& encoded() const { return code; }
+	bool encodedValid() const { return valid; } // false once a line was not an instruction the encoder knows
+
+	// The contents for the build cache and back
+	std::string save() const { return encode ? code.save() : data; }
+	bool restore(std::string_view saved) {
+		if (!encode) {
+			data.append(saved);
+			return true;
+		}
+		ObjectSection restored;
+		if (!restored.restore(saved)) return false;
+		code.append(std::move(restored));
+		return true;
+	}
+
+private:
+	std::string data; // the assembly, or the line being written while encoding
+	bool encode = false;
+	bool inComment = false; // the line being encoded is a comment, so the rest of it is dropped
+	bool valid = true;
+	ObjectSection code;
+
+	void append(std::string_view text) {
+		if (inComment) return;
+		if (encode && data.empty() && text.starts_with("//")) inComment = true;
+		else data.append(text);
+	}
+	void encodeLine(std::string_view line) {
+		valid = code.assembleLine(line) && valid;
+	}
+	void endLine() {
+		if (!inComment) encodeLine(data);
+		data.clear();
+		inComment = false;
+	}
+};
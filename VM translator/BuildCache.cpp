@@ -0,0 +1,94 @@
+#include "BuildCache.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+BuildCache::BuildCache(const filesystem::path& directory, uintmax_t maxBytes): directory(directory), maxBytes(maxBytes)
+{
+}
+
+BuildCache::~BuildCache()
+{
+	if (stored) trim();
+}
+
+void BuildCache::trim() const
+{
+	struct Entry {
+		filesystem::file_time_type time;
+		uintmax_t size;
+		filesystem::path path;
+	};
+	vector<Entry> entries;
+	uintmax_t total = 0;
+	error_code ec;
+	for (auto& file : filesystem::directory_iterator(directory, ec)) {
+		Entry entry{ file.last_write_time(ec), file.file_size(ec), file.path() };
+		if (ec) continue;
+		total += entry.size;
+		entries.push_back(std::move(entry));
+	}
+	if (total <= maxBytes) return;
+	sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+	for (auto& entry : entries) {
+		if (total <= maxBytes) break;
+		if (filesystem::remove(entry.path, ec)) total -= entry.size;
+	}
+}
+
+filesystem::path BuildCache::entry(uint64_t key) const
+{
+	ostringstream name;
+	name << hex << setw(16) << setfill('0') << key;
+	return directory / name.str();
+}
+
+bool BuildCache::load(uint64_t key, string& contents) const
+{
+	ifstream file(entry(key), ios::binary);
+	if (!file.is_open()) return false;
+	ostringstream data;
+	data << file.rdbuf();
+	contents = std::move(data).str();
+	error_code ec;
+	filesystem::last_write_time(entry(key), filesystem::file_time_type::clock::now(), ec); // recently used, kept by trim()
+	return true;
+}
+
+void BuildCache::store(uint64_t key, string_view contents) const
+{
+	// Written under a temporary name and renamed, so a reader never sees half an entry
+	error_code ec;
+	filesystem::create_directories(directory, ec);
+	filesystem::path path = entry(key);
+	ostringstream suffix;
+	suffix << ".tmp" << this_thread::get_id();
+	filesystem::path temporary = path;
+	temporary += suffix.str();
+	{
+		ofstream file(temporary, ios::binary);
+		if (!file.is_open()) return; // the cache is an optimization, a read-only disk just disables it
+		file.write(contents.data(), contents.size());
+	}
+	filesystem::rename(temporary, path, ec);
+	stored = true;
+}
+
+uint64_t BuildCache::hash(string_view data, uint64_t seed)
+{
+	for (unsigned char c : data) {
+		seed ^= c;
+		seed *= 1099511628211ull;
+	}
+	return seed;
+}
+
+uint64_t BuildCache::hash(long long value, uint64_t seed)
+{
+	return hash(string_view(reinterpret_cast<const char*>(&value), sizeof(value)), seed);
+}
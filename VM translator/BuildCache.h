@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <cstdint>
+#include <atomic>
+
+// Outputs of earlier runs, one file per entry named after a hash of everything that went into
+// it (the input, the settings that affect it and the tool's format version). Shared by the
+// compiler, the VM translator and the toolchain.
+// A hit refreshes the entry's time, and when a run has stored anything the cache is trimmed
+// back to maxBytes on destruction, least recently used entries first.
+class BuildCache
+{
+public:
+	static constexpr uintmax_t DEFAULT_MAX_BYTES = 32 * 1024 * 1024;
+
+	BuildCache(const std::filesystem::path& directory, uintmax_t maxBytes = DEFAULT_MAX_BYTES); // created on the first store
+	BuildCache(const BuildCache&) = delete;
+	BuildCache& operator=(const BuildCache&) = delete;
+	~BuildCache();
+	bool load(uint64_t key, std::string& contents) const;
+	void store(uint64_t key, std::string_view contents) const;
+
+	// 64-bit FNV-1a. Pass the previous result as seed to build one key from several parts.
+	static uint64_t hash(std::string_view data, uint64_t seed = 14695981039346656037ull);
+	static uint64_t hash(long long value, uint64_t seed);
+
+private:
+	std::filesystem::path directory;
+	uintmax_t maxBytes;
+	mutable std::atomic<bool> stored{ false }; // stores come from the translator's worker threads
+	void trim() const;
+	std::filesystem::path entry(uint64_t key) const;
+};
@@ -1,28 +1,36 @@
 #include "CodeWriter.h"
 #include "Shared.h"
+#include "ProgramAnalysis.h"
 #include <string>
 #include <iostream>
 #include <fstream>
 #include <set>
 #include <map>
 #include <algorithm>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
 
 using namespace std;
 
-const set<string> CodeWriter::arithCommands = { "add", "sub", "neg", "eq", "gt", "lt", "and", "or", "not" };
+// Part of every cache key; change it whenever the generated code changes
+static const string_view translatorVersion = "HackVMTranslator 1";
 
-const map<string, string> CodeWriter::segmentMap = { { "local", "LCL" }, { "this", "THIS" }, { "that", "THAT"}, { "argument", "ARG" } };
+// Largest deferred SP adjustment. Slots further from RAM[SP] take an extra A=A+1 each to reach
+// and the write-back an extra M=M+1, which costs more than updating SP as it goes.
+static constexpr int MAX_SP_OFFSET = 2;
 
-const map<string, Segment> CodeWriter::segmentEnumMap = {
-	{ "local", Segment::LOCAL },
-	{ "this", Segment::THIS },
-	{ "that", Segment::THAT },
-	{ "argument", Segment::ARG },
-	{ "constant", Segment::CONST },
-	{ "static", Segment::STATIC },
-	{ "pointer", Segment::POINTER },
-	{ "temp", Segment::TEMP }
-};
+static const char* arithNames[] = { "add", "sub", "neg", "eq", "gt", "lt", "and", "or", "not" };
+
+static const char* segmentNames[] = { "constant", "argument", "local", "static", "this", "that", "pointer", "temp", "named" };
+
+// Base address registers of the segments that are reached through a pointer
+static const char* segmentPointers[] = { "", "ARG", "LCL", "", "THIS", "THAT", "", "", "" };
+
+CodeWriter::CodeWriter()
+{
+}
 
 CodeWriter::CodeWriter(const std::string& filename): outputFilename(filename)
 {
@@ -35,135 +43,153 @@ CodeWriter::CodeWriter(const std::string& filename): outputFilename(filename)
 	}
 }
 
-void CodeWriter::writeArithmetic(const std::string& command)
+void CodeWriter::writeArithmetic(Arith command)
 {
-	string output = ("// " + command + "\n");
+	if (cacheTop) {
+		writeCachedArithmetic(command);
+		return;
+	}
+	outputBuffer << "// " << arithNames[static_cast<int>(command)] << "\n";
 	// Get first value from stack
-	output += "@SP\n"
+	outputBuffer << "@SP\n"
 		"A=M-1\n";
-	if (command == "neg") {
-		output += "M=-M\n";
-		outputFile << output;
+	if (command == Arith::NEG) {
+		outputBuffer << "M=-M\n";
 		return;
 	}
-	else if (command == "not") {
-		output += "M=!M\n";
-		outputFile << output;
+	else if (command == Arith::NOT) {
+		outputBuffer << "M=!M\n";
 		return;
 	}
 	// Save first value and get second value from stack
-	output += "D=M\n"
+	outputBuffer << "D=M\n"
 		"@SP\n"
 		"M=M-1\n"
 		"A=M-1\n";
 	// Now D holds the first value (y) and M holds the second value (x)
-	if (command == "add") {
-		output += "M=M+D\n";
+	if (command == Arith::ADD) {
+		outputBuffer << "M=M+D\n";
 	}
-	else if (command == "and") {
-		output += "M=M&D\n";
+	else if (command == Arith::AND) {
+		outputBuffer << "M=M&D\n";
 	}
-	else if (command == "or") {
-		output += "M=M|D\n";
+	else if (command == Arith::OR) {
+		outputBuffer << "M=M|D\n";
 	}
 	else {
-		if (command == "sub") {
-			output += "M=M-D\n";
-			outputFile << output;
+		if (command == Arith::SUB) {
+			outputBuffer << "M=M-D\n";
 			return;
 		}
-		output += "D=M-D\n"; // store difference
-		output += "M=0\n"; // start with assumption the result is false
-		if (command == "eq" || command == "gt" || command == "lt") 
-			output += "@TRUE_" + to_string(arithCount) + "\n";
+		outputBuffer << "D=M-D\n"; // store difference
+		outputBuffer << "M=0\n"; // start with assumption the result is false
+		if (command == Arith::EQ || command == Arith::GT || command == Arith::LT) 
+			outputBuffer << "@" << funcPrefix << currFunction << "$TRUE$" << arithCount << "\n";
 
-		if (command == "eq") {
-			output += "D;JEQ\n";
+		if (command == Arith::EQ) {
+			outputBuffer << "D;JEQ\n";
 		}
-		else if (command == "gt") {
-			output += "D;JGT\n";
+		else if (command == Arith::GT) {
+			outputBuffer << "D;JGT\n";
 		}
-		else if (command == "lt") {
-			output += "D;JLT\n";
+		else if (command == Arith::LT) {
+			outputBuffer << "D;JLT\n";
 		}
 
-		output += "@FALSE_" + to_string(arithCount) + "\n"
+		outputBuffer << "@" << funcPrefix << currFunction << "$FALSE$" << arithCount << "\n"
 			"0;JMP\n"
-			"(TRUE_" + to_string(arithCount) + ")\n"
+			"(" << funcPrefix << currFunction << "$TRUE$" << arithCount << ")\n"
 			"@SP\n"
 			"A=M-1\n"
 			"M=-1\n" // In VM, true is represented by -1
-			"(FALSE_" + to_string(arithCount) + ")\n";
+			"(" << funcPrefix << currFunction << "$FALSE$" << arithCount << ")\n";
 		
 		++arithCount;
 	}
-	outputFile << output;
 }
 
-string CodeWriter::getSegmentReference(const string& segment, int index) {
-	Segment seg = segmentEnumMap.at(segment);
+string_view CodeWriter::segmentName(Segment segment, int name) const
+{
+	return segment == Segment::NAMED ? string_view((*names)[name]) : segmentNames[static_cast<int>(segment)];
+}
 
-	switch (seg) {
+void CodeWriter::writeSegmentReference(Segment segment, int index, int name) {
+	switch (segment) {
+	case Segment::NAMED:
+		outputBuffer << "@" << (*names)[name] << "." << index << "\n";
+		break;
 	case Segment::CONST:
-		return "@" + to_string(index) + "\n";
+		outputBuffer << "@" << index << "\n";
+		break;
 	case Segment::STATIC:
-		return "@" + inputFilename.substr(0, inputFilename.find_last_of(".") + 1) + to_string(index) + "\n";
+		outputBuffer << "@" << staticPrefix << index << "\n";
+		break;
 	case Segment::TEMP:
 		if (TEMP_START + index > 12) {
 			cout << "Invalid call to temp segment (" << to_string(TEMP_START + index) << "), exceeds bounds" << endl;
-			return "";
+			break;
 		}
-		return "@" + to_string(TEMP_START + index) + "\n";
+		outputBuffer << "@" << TEMP_START + index << "\n";
+		break;
 	case Segment::POINTER:
 		if (index == 0) {
-			return "@THIS\n";
+			outputBuffer << "@THIS\n";
 		}
 		else if (index == 1) {
-			return "@THAT\n";
+			outputBuffer << "@THAT\n";
 		}
 		else {
 			cout << "Invalid call to pointer memory segment: pointer " + to_string(index) << endl;
-			return "";
 		}
+		break;
+	case Segment::ARG:
+	case Segment::LOCAL:
+		if (currStatic) {
+			outputBuffer << "@" << currStatic->base + (segment == Segment::LOCAL ? currStatic->numArgs : 0) + index << "\n";
+			break;
+		}
+		[[fallthrough]];
 	default:
-		string output;
-		if (index > 2) output += ("@" + to_string(index) + "\n"
-			"D=A\n");
-		output += "@" + segmentMap.find(segment)->second + "\n";
-		if (index > 2) output += "A=M+D\n";
+		if (index > 2) outputBuffer << "@" << index << "\n"
+			"D=A\n";
+		outputBuffer << "@" << segmentPointers[static_cast<int>(segment)] << "\n";
+		if (index > 2) outputBuffer << "A=M+D\n";
 		else if (index > 0) {
-			output += "A=M+1\n";
-			if (index == 2) output += "A=A+1\n";
+			outputBuffer << "A=M+1\n";
+			if (index == 2) outputBuffer << "A=A+1\n";
 		}
-		else output += "A=M\n";
-		return output;
+		else outputBuffer << "A=M\n";
 	}
 }
 
-void CodeWriter::writePush(const string& segment, int index, bool beforePop)
+void CodeWriter::writePush(Segment segment, int index, bool beforePop, int name)
 {
-	outputFile << "// push " << segment << " " << to_string(index) << ", beforePop = " << beforePop << "\n";
+	if (cacheTop) {
+		writeCachedPush(segment, index, name);
+		return;
+	}
+	outputBuffer << "// push " << segmentName(segment, name) << " " << index << ", beforePop = " << beforePop << "\n";
 		
-	if (segment == "constant" && index <= 2) {
+	if (segment == Segment::CONST && index <= 2) {
 		if (!beforePop) {
-			outputFile << "@SP\n"
+			outputBuffer << "@SP\n"
 				"M=M+1\n"
 				"A=M-1\n"
-				"M=" << to_string(std::min(1,index)) << "\n";
-			if (index == 2) outputFile << "M=M+1\n";
+				"M=" << std::min(1,index) << "\n";
+			if (index == 2) outputBuffer << "M=M+1\n";
 		}
 		else {
-			outputFile << "D=" << to_string(std::min(1,index)) << "\n";
-			if (index == 2) outputFile << "D=D+1\n";
+			outputBuffer << "D=" << std::min(1,index) << "\n";
+			if (index == 2) outputBuffer << "D=D+1\n";
 		}
 	}
 	else {
-		outputFile << getSegmentReference(segment, index); // A/M is now at referenced segment and index
+		writeSegmentReference(segment, index, name); // A/M is now at referenced segment and index
 
-		if (segment == "constant") outputFile << "D=A\n";
-		else outputFile << "D=M\n";
+		if (segment == Segment::CONST) outputBuffer << "D=A\n";
+		else outputBuffer << "D=M\n";
 		if (!beforePop) {
-			outputFile << "@SP\n"
+			outputBuffer << "@SP\n"
 				"M=M+1\n"
 				"A=M-1\n"
 				"M=D\n";
@@ -171,62 +197,399 @@ void CodeWriter::writePush(const string& segment, int index, bool beforePop)
 	}
 }
 
-void CodeWriter::writePop(const string& segment, int index, bool afterPush) {
-	if (segment == "constant") {
+void CodeWriter::writePop(Segment segment, int index, bool afterPush, int name) {
+	if (segment == Segment::CONST) {
 		cout << "Error, attempted to pop to constant memory segment" << endl;
 		return; // pop constant not allowed
 	}
+	if (cacheTop) {
+		writeCachedPop(segment, index, name);
+		return;
+	}
 
-	outputFile << "// pop " << segment << " " << to_string(index) << ", afterPush = " << afterPush << "\n";
+	outputBuffer << "// pop " << segmentName(segment, name) << " " << index << ", afterPush = " << afterPush << "\n";
 
-	bool segmentNeedsAddition = (segment == "local" || segment == "this" || segment == "that" || segment == "argument");
+	bool segmentNeedsAddition = isIndirect(segment);
 	if (segmentNeedsAddition && index > 0) {
 		if (afterPush) {
-			outputFile << "@SP\n"
+			outputBuffer << "@SP\n"
 				"A=M\n"
 				"M=D\n";
 		}
 		if (index > 2) {
-			outputFile <<
-				"@" << to_string(index) << "\n"
+			outputBuffer <<
+				"@" << index << "\n"
 				"D=A\n";
 		}
-		outputFile << "@" << segmentMap.find(segment)->second << "\n";
+		outputBuffer << "@" << segmentPointers[static_cast<int>(segment)] << "\n";
 		if (index <= 2) {
-			outputFile << "D=M+1\n";
-			if (index == 2) outputFile << "D=D+1\n";
+			outputBuffer << "D=M+1\n";
+			if (index == 2) outputBuffer << "D=D+1\n";
 		}
 		else {
-			outputFile << "D=M+D\n";
+			outputBuffer << "D=M+D\n";
 		}  // address of where we want to store popped item now held in D
 		if (afterPush) {
-			outputFile << "@SP\n"
+			outputBuffer << "@SP\n"
 				"A=M\n";
 		}
 		else {
-			outputFile << "@SP\n"
+			outputBuffer << "@SP\n"
 				"AM=M-1\n";
 		}
-		outputFile << "D=M+D\n"  // add address to popped value, since we only have one register to work with
+		outputBuffer << "D=M+D\n"  // add address to popped value, since we only have one register to work with
 			"A=D-M\n"  // undo previous operation to extract original address and jump to it
 			"M=D-A\n"; // subtract address from D to get popped value
 	}
 
 	else {
 		if (!afterPush) {
-			outputFile << "@SP\n"
+			outputBuffer << "@SP\n"
 				"AM=M-1\n"
 				"D=M\n"; // last element in stack is now stored in D
 		}
-			outputFile << getSegmentReference(segment, index) // A/M is now at referenced segment and index
-			<< "M=D\n";
+		writeSegmentReference(segment, index, name); // A/M is now at referenced segment and index
+		outputBuffer << "M=D\n";
 	}	
 }
 
+void CodeWriter::spillTop(bool sync)
+{
+	if (!topInD) return;
+	topInD = false;
+	if (deferSP && !sync && spOffset < MAX_SP_OFFSET) {
+		writeStackSlot(0);
+		outputBuffer << "M=D\n";
+		++spOffset;
+		return;
+	}
+	// SP is written back on the way: it is stepped to its new value and the slot below it filled
+	++spOffset;
+	if (spOffset == 0) {
+		writeStackSlot(-1);
+	}
+	else {
+		adjustStackPointer();
+		outputBuffer << "A=M-1\n";
+	}
+	outputBuffer << "M=D\n";
+}
+
+void CodeWriter::adjustStackPointer()
+{
+	outputBuffer << "@SP\n";
+	for (int i = 0; i < std::abs(spOffset); ++i) outputBuffer << (spOffset > 0 ? "M=M+1\n" : "M=M-1\n");
+	spOffset = 0;
+}
+
+void CodeWriter::writeStackSlot(int offset)
+{
+	const int slot = spOffset + offset;
+	outputBuffer << "@SP\n" << (slot == 0 ? "A=M\n" : slot > 0 ? "A=M+1\n" : "A=M-1\n");
+	for (int i = 1; i < std::abs(slot); ++i) outputBuffer << (slot > 0 ? "A=A+1\n" : "A=A-1\n");
+}
+
+void CodeWriter::writeStackPop(string_view use, bool sync)
+{
+	if (deferSP && !sync && spOffset > -MAX_SP_OFFSET) {
+		writeStackSlot(-1);
+		outputBuffer << use << "\n";
+		--spOffset;
+		return;
+	}
+	// SP is written back on the way, the popped value is the slot it now points at
+	--spOffset;
+	if (spOffset < 0) {
+		++spOffset;
+		adjustStackPointer();
+		outputBuffer << "AM=M-1\n";
+	}
+	else {
+		adjustStackPointer();
+		outputBuffer << "A=M\n";
+	}
+	outputBuffer << use << "\n";
+}
+
+void CodeWriter::flushStackPointer()
+{
+	// Steps RAM[SP] one at a time, which leaves D alone
+	if (spOffset != 0) adjustStackPointer();
+}
+
+void CodeWriter::settleStack()
+{
+	if (topInD) spillTop(true);
+	else flushStackPointer();
+}
+
+void CodeWriter::writeCachedArithmetic(Arith command)
+{
+	outputBuffer << "// " << arithNames[static_cast<int>(command)] << "\n";
+	if (command == Arith::NEG || command == Arith::NOT) {
+		const char* op = (command == Arith::NEG ? "-" : "!");
+		if (topInD) outputBuffer << "D=" << op << "D\n";
+		else {
+			writeStackSlot(-1);
+			outputBuffer << "M=" << op << "M\n";
+		}
+		return;
+	}
+
+	const char* op = "+";
+	if (command == Arith::SUB) op = "-";
+	else if (command == Arith::AND) op = "&";
+	else if (command == Arith::OR) op = "|";
+	const bool isCompare = (command == Arith::EQ || command == Arith::GT || command == Arith::LT);
+	if (isCompare) op = "-";
+
+	if (!topInD) {
+		writeStackPop("D=M");
+		if (!isCompare) { // x stays in RAM, so combine in place
+			outputBuffer << "A=A-1\n"
+				"M=M" << op << "D\n";
+			return;
+		}
+	}
+	// y is in D, x is the top of the RAM stack
+	writeStackPop(string("D=M") + op + "D");
+	topInD = true;
+	if (!isCompare) return;
+
+	const char* jump = (command == Arith::EQ ? "JEQ" : command == Arith::GT ? "JGT" : "JLT");
+	outputBuffer << "@" << funcPrefix << currFunction << "$TRUE$" << arithCount << "\n"
+		"D;" << jump << "\n"
+		"D=0\n"
+		"@" << funcPrefix << currFunction << "$FALSE$" << arithCount << "\n"
+		"0;JMP\n"
+		"(" << funcPrefix << currFunction << "$TRUE$" << arithCount << ")\n"
+		"D=-1\n"
+		"(" << funcPrefix << currFunction << "$FALSE$" << arithCount << ")\n";
+	++arithCount;
+}
+
+void CodeWriter::writeCachedPush(Segment segment, int index, int name)
+{
+	outputBuffer << "// push " << segmentName(segment, name) << " " << index << "\n";
+	spillTop();
+	if (segment == Segment::CONST && index <= 1) {
+		outputBuffer << "D=" << index << "\n";
+	}
+	else {
+		writeSegmentReference(segment, index, name);
+		outputBuffer << (segment == Segment::CONST ? "D=A\n" : "D=M\n");
+	}
+	topInD = true;
+}
+
+void CodeWriter::writeCachedPop(Segment segment, int index, int name)
+{
+	outputBuffer << "// pop " << segmentName(segment, name) << " " << index << "\n";
+	bool segmentNeedsAddition = isIndirect(segment);
+
+	if (segmentNeedsAddition && index >= 10) {
+		// D is needed for the address, so park the value in the freed stack slot
+		flushStackPointer();
+		if (topInD) outputBuffer << "@SP\n"
+			"A=M\n"
+			"M=D\n";
+		else outputBuffer << "@SP\n"
+			"M=M-1\n";
+		outputBuffer << "@" << index << "\n"
+			"D=A\n"
+			"@" << segmentPointers[static_cast<int>(segment)] << "\n"
+			"D=M+D\n"
+			"@SP\n"
+			"A=M\n"
+			"D=M+D\n"
+			"A=D-M\n"
+			"M=D-A\n";
+		topInD = false;
+		return;
+	}
+
+	if (!topInD) {
+		writeStackPop("D=M");
+	}
+	if (segmentNeedsAddition) {
+		// Stepping A keeps D intact and is no longer than computing the address for small offsets
+		outputBuffer << "@" << segmentPointers[static_cast<int>(segment)] << "\n"
+			<< (index == 0 ? "A=M\n" : "A=M+1\n");
+		for (int i = 1; i < index; ++i) outputBuffer << "A=A+1\n";
+	}
+	else {
+		writeSegmentReference(segment, index, name);
+	}
+	outputBuffer << "M=D\n";
+	topInD = false;
+}
+
+void CodeWriter::setTopOfStackCaching(bool enabled)
+{
+	cacheTop = enabled;
+}
+
+void CodeWriter::setDeferredStackPointer(bool enabled)
+{
+	deferSP = enabled;
+}
+
+void CodeWriter::setSharedCompares(const std::vector<bool>* sites)
+{
+	sharedCompares = sites;
+}
+
+bool CodeWriter::sharedComparesAreSmaller() const
+{
+	return !cacheTop;
+}
+
+void CodeWriter::setFrameLayout(const FrameLayout* layout)
+{
+	frames = layout;
+}
+
+void CodeWriter::inheritSettings(const CodeWriter& other)
+{
+	cacheTop = other.cacheTop;
+	deferSP = other.deferSP;
+	sharedCompares = other.sharedCompares;
+	frames = other.frames;
+	outputBuffer.setEncoding(other.outputBuffer.encoding());
+}
+
+FrameLayout CodeWriter::planFrames(const VMProgram& program, const std::vector<int>& selected, bool useShapes, bool useStaticFrames,
+	const ExternalCalls* external)
+{
+	// A function only gets a shape or a static frame when every call site passes the same
+	// number of arguments, otherwise ARG cannot be placed at a fixed offset from the frame.
+	// Call sites outside the program use the generic frame.
+	unordered_map<int, int> numArgs = callArgCounts(program, selected);
+	if (external) {
+		for (int f : external->entered) numArgs[program.functions[f].name] = -1;
+	}
+	auto writesPointer = [&](const VMFunction& function) {
+		return std::any_of(program.code.begin() + function.begin, program.code.begin() + function.end,
+			[](const VMInstruction& instruction) { return instruction.command == Command::C_POP && instruction.segment == Segment::POINTER; });
+	};
+
+	FrameLayout layout;
+	if (useStaticFrames) {
+		// Functions that are never on the call stack together share memory: each frame starts
+		// after the frames of everything that can call it, walking the call graph callers first.
+		// Recursive functions keep the stack frame and take no room.
+		constexpr int MAX_STATIC_REGION = 1024; // leaves the stack at least 768 words below the heap
+		CallGraph graph(program, selected, external);
+		vector<int> offset(program.functions.size(), 0);
+		for (auto& component : graph.components()) {
+			int start = 0;
+			for (int f : component) start = std::max(start, offset[f]);
+			int end = start;
+
+			const VMFunction& function = program.functions[component[0]];
+			auto it = (function.name >= 0 ? numArgs.find(function.name) : numArgs.end());
+			if (component.size() == 1 && !graph.isRecursive(component[0]) && it != numArgs.end() && it->second >= 0
+				&& isStackBalanced(program, function)) {
+				StaticFrame frame;
+				frame.numArgs = it->second;
+				frame.numLocals = function.numVars;
+				frame.savePointers = writesPointer(function);
+				if (start + frame.size() <= MAX_STATIC_REGION) {
+					frame.base = STACK_BASE + start;
+					end = start + frame.size();
+					layout.staticFrames.emplace(program.names[function.name], frame);
+				}
+			}
+			layout.staticRegionSize = std::max(layout.staticRegionSize, end);
+			for (int f : component) {
+				for (int callee : graph.callees(f)) offset[callee] = std::max(offset[callee], end);
+			}
+		}
+	}
+	if (!useShapes) return layout;
+
+	for (int f : selected) {
+		const VMFunction& function = program.functions[f];
+		if (function.name < 0 || layout.staticFrames.count(program.names[function.name])) continue;
+		auto it = numArgs.find(function.name);
+		if (it == numArgs.end() || it->second < 0) continue;
+
+		FrameShape shape;
+		shape.numArgs = it->second;
+		shape.numLocals = function.numVars;
+		bool usesLocal = false;
+		for (size_t i = function.begin; i < function.end; ++i) {
+			const VMInstruction& instruction = program.code[i];
+			if ((instruction.command == Command::C_PUSH || instruction.command == Command::C_POP) && instruction.segment == Segment::LOCAL) usesLocal = true;
+		}
+		// A callee that writes pointer restores THIS/THAT itself, so a function that does
+		// not write them returns them unchanged no matter what it calls
+		shape.savePointers = writesPointer(function);
+		shape.saveLocal = !function.calls.empty() || function.numVars > 0 || usesLocal;
+
+		auto shapeIt = std::find(layout.shapes.begin(), layout.shapes.end(), shape);
+		if (shapeIt == layout.shapes.end()) {
+			layout.shapes.push_back(shape);
+			shapeIt = layout.shapes.end() - 1;
+		}
+		layout.shapeOf.emplace(program.names[function.name], static_cast<int>(shapeIt - layout.shapes.begin()));
+	}
+	return layout;
+}
+
+const StaticFrame* CodeWriter::staticFrameOf(const std::string& functionName) const
+{
+	if (!frames) return nullptr;
+	auto it = frames->staticFrames.find(functionName);
+	return it != frames->staticFrames.end() ? &it->second : nullptr;
+}
+
+bool CodeWriter::isIndirect(Segment segment) const
+{
+	if (segment == Segment::ARG || segment == Segment::LOCAL) return !currStatic;
+	return segment == Segment::THIS || segment == Segment::THAT;
+}
+
+int CodeWriter::shapeOf(const std::string& functionName) const
+{
+	if (!frames) return -1;
+	auto it = frames->shapeOf.find(functionName);
+	return it != frames->shapeOf.end() ? it->second : -1;
+}
+
+string CodeWriter::enterStub(const FrameShape& shape)
+{
+	return "__Enter_" + to_string(shape.numArgs) + "_" + to_string(shape.numLocals) + "_" + (shape.saveLocal ? "L" : "") + (shape.savePointers ? "P" : "") + "__";
+}
+
+string CodeWriter::leaveStub(const FrameShape& shape)
+{
+	// Frames with LCL are found through it, the others sit right after the arguments
+	string prefix = shape.saveLocal ? "__Leave_" : "__Leave_" + to_string(shape.numArgs) + "_";
+	return prefix + (shape.saveLocal ? "L" : "") + (shape.savePointers ? "P" : "") + "__";
+}
+
+bool CodeWriter::foldsIntoBranch(const std::vector<VMInstruction>& code, size_t i, size_t end)
+{
+	size_t next = i + 1;
+	if (next < end && code[next].command == Command::C_ARITHMETIC && code[next].arith == Arith::NOT) ++next;
+	return next < end && code[next].command == Command::C_IF;
+}
+
+int CodeWriter::countInstructions(const VMProgram& program, const std::vector<int>& selected, int jobs)
+{
+	CodeWriter scratch;
+	scratch.inheritSettings(*this);
+	scratch.writeInit();
+	scratch.translate(program, selected, jobs);
+	return scratch.outputBuffer.instructionCount();
+}
+
 void CodeWriter::setFilename(const std::string& filename)
 {
 	// cout << "Updating filename to " << filename << endl;
 	inputFilename = filename;
+	staticPrefix = filename.substr(0, filename.find_last_of(".") + 1);
 	funcPrefix = ""; // this was previously included in case the VM translator was expected to add a filename prefix to functions.
 					 // turns out this is already done by the Jack compiler, so not necessary here. 
 }
@@ -234,9 +597,9 @@ void CodeWriter::setFilename(const std::string& filename)
 void CodeWriter::writeInit()
 {
 	// bootstrap code to initialize VM
-	constexpr int STACK_START = 256;
+	const int stackStart = STACK_BASE + (frames ? frames->staticRegionSize : 0);
 
-	outputFile << "@" << STACK_START << "\n"
+	outputBuffer << "@" << stackStart << "\n"
 		"D=A\n"
 		"@SP\n"
 		"M=D\n"
@@ -245,63 +608,137 @@ void CodeWriter::writeInit()
 	
 	writeCallBootstrap();
 	writeReturnBootstrap();
+	if (frames) {
+		writeFrameStubs();
+	}
+	if (sharedCompares && std::find(sharedCompares->begin(), sharedCompares->end(), true) != sharedCompares->end()) {
+		writeCompareBootstrap();
+	}
 
-	outputFile << "(SysInit)\n";
+	outputBuffer << "(SysInit)\n";
 	writeCall("Sys.init", 0);
 }
 
 void CodeWriter::writeLabel(const std::string& label)
 {
-	outputFile << "// label " + label + "\n"
-		"(" + funcPrefix + currFunction + "$" + label + ")\n";
+	settleStack();
+	outputBuffer << "// label " << label << "\n"
+		"(" << funcPrefix << currFunction << "$" << label << ")\n";
 }
 
 void CodeWriter::writeGoto(const std::string& label)
 {
-	outputFile << "// goto " + label + "\n"
-		"@" + funcPrefix + currFunction + "$" + label + "\n"
+	settleStack();
+	outputBuffer << "// goto " << label << "\n"
+		"@" << funcPrefix << currFunction << "$" << label << "\n"
 		"0;JMP\n";
 }
 
 void CodeWriter::writeIf(const std::string& label)
 {
-	outputFile << "// if-goto " + label + "\n"
-		"@SP\n"
-		"AM=M-1\n"
-		"D=M\n"
-		"@" + funcPrefix + currFunction + "$" + label + "\n"
+	outputBuffer << "// if-goto " << label << "\n";
+	if (!topInD) {
+		writeStackPop("D=M", true);
+	}
+	flushStackPointer();
+	outputBuffer << "@" << funcPrefix << currFunction << "$" << label << "\n"
 		"D;JNE\n";
+	topInD = false;
+}
+
+void CodeWriter::writeCompareIf(Arith compare, bool negate, const std::string& label)
+{
+	if (compare == Arith::NONE) { // not, if-goto: !x is non-zero, so the jump is taken, unless x is -1
+		outputBuffer << "// not, if-goto " << label << "\n";
+		if (!topInD) {
+			writeStackPop("D=M+1", true);
+		}
+		else {
+			outputBuffer << "D=D+1\n";
+		}
+		flushStackPointer();
+		outputBuffer << "@" << funcPrefix << currFunction << "$" << label << "\n"
+			"D;JNE\n";
+		topInD = false;
+		return;
+	}
+
+	outputBuffer << "// " << arithNames[static_cast<int>(compare)] << (negate ? ", not" : "") << ", if-goto " << label << "\n";
+	if (!topInD) {
+		writeStackPop("D=M");
+	}
+	writeStackPop("D=M-D", true);
+	outputBuffer << "@" << funcPrefix << currFunction << "$" << label << "\n";
+	if (compare == Arith::EQ) outputBuffer << (negate ? "D;JNE\n" : "D;JEQ\n");
+	else if (compare == Arith::GT) outputBuffer << (negate ? "D;JLE\n" : "D;JGT\n");
+	else outputBuffer << (negate ? "D;JGE\n" : "D;JLT\n");
+	topInD = false;
+	++arithCount; // no labels are needed, but the numbering stays in step with translate()'s per-function counts
 }
 
 void CodeWriter::writeFunction(const std::string& functionName, int numVars)
 {
+	topInD = false;
+	spOffset = 0;
 	currFunction = functionName;
-	outputFile << "// function " + functionName + " " + to_string(numVars) + "\n"
-		"(" + funcPrefix + functionName + ")\n";
+	arithCount = 0; // comparison labels are numbered per function, like return addresses
+	outputBuffer << "// function " << functionName << " " << numVars << "\n"
+		"(" << funcPrefix << functionName << ")\n";
+
+	currShape = shapeOf(functionName);
+	currStatic = staticFrameOf(functionName);
+	if (currShape >= 0) {
+		return; // the entry stub has set up LCL and the locals
+	}
+	if (currStatic) {
+		// the return address is in D and the arguments are on the stack
+		outputBuffer << "@" << currStatic->returnSlot() << "\n"
+			"M=D\n";
+		for (int k = currStatic->numArgs - 1; k >= 0; --k) {
+			outputBuffer << "@SP\n"
+				"AM=M-1\n"
+				"D=M\n"
+				"@" << currStatic->base + k << "\n"
+				"M=D\n";
+		}
+		if (currStatic->savePointers) outputBuffer << "@THIS\n"
+			"D=M\n"
+			"@" << currStatic->returnSlot() + 1 << "\n"
+			"M=D\n"
+			"@THAT\n"
+			"D=M\n"
+			"@" << currStatic->returnSlot() + 2 << "\n"
+			"M=D\n";
+		for (int i = 0; i < numVars; ++i) {
+			outputBuffer << "@" << currStatic->base + currStatic->numArgs + i << "\n"
+				"M=0\n";
+		}
+		return;
+	}
 
-	outputFile << "@SP\n"
+	outputBuffer << "@SP\n"
 		"D=M\n"
 		"@LCL\n" // update LCL to match SP even when 0 vars
 		"M=D\n";
 
 	if (numVars > 0) {
 		if (numVars > 2) {
-			outputFile << "@" + to_string(numVars) + "\n"
+			outputBuffer << "@" << numVars << "\n"
 				"D=A\n"
 				"@SP\n"
 				"M=M+D\n";
 		}
 		else {
-			outputFile << "@SP\n"
+			outputBuffer << "@SP\n"
 				"M=M+1\n";
-			if (numVars == 2) outputFile << "M=M+1\n";
+			if (numVars == 2) outputBuffer << "M=M+1\n";
 		}
 		
-		outputFile << "A=M-1\n";
+		outputBuffer << "A=M-1\n";
 		for (int i = 0; i < numVars; ++i) {
-			outputFile << "M=0\n";
+			outputBuffer << "M=0\n";
 			if (i < numVars - 1)
-				outputFile << "A=A-1\n";
+				outputBuffer << "A=A-1\n";
 		}
 
 	}
@@ -309,6 +746,7 @@ void CodeWriter::writeFunction(const std::string& functionName, int numVars)
 
 void CodeWriter::writeCall(const std::string& functionName, int numArgs)
 {
+	settleStack();
 	int callCount = 1;
 
 	auto callIt = functionCallCount.find(currFunction);
@@ -320,43 +758,66 @@ void CodeWriter::writeCall(const std::string& functionName, int numArgs)
 		functionCallCount.emplace(currFunction, 1);
 	}	
 
-	const string returnSymbol = funcPrefix + currFunction + "$ret." + to_string(callCount);
+	outputBuffer << "// call " << functionName << " " << numArgs << "\n";
+	const StaticFrame* callee = staticFrameOf(functionName);
+	if (callee && callee->numArgs == numArgs) {
+		// jump with the return address in D, the callee moves its arguments into its frame
+		outputBuffer << "@" << funcPrefix << currFunction << "$ret." << callCount << "\n"
+			"D=A\n"
+			"@" << funcPrefix << functionName << "\n"
+			"0;JMP\n"
+			"(" << funcPrefix << currFunction << "$ret." << callCount << ")\n";
+		return;
+	}
+	int shape = shapeOf(functionName);
+	if (shape >= 0 && frames->shapes[shape].numArgs == numArgs) {
+		// function name (address) in R15 and return address in D, then call the entry stub of its shape
+		outputBuffer << "@" << funcPrefix << functionName << "\n"
+			"D=A\n"
+			"@R15\n"
+			"M=D\n"
+			"@" << funcPrefix << currFunction << "$ret." << callCount << "\n"
+			"D=A\n"
+			"@" << enterStub(frames->shapes[shape]) << "\n"
+			"0;JMP\n"
+			"(" << funcPrefix << currFunction << "$ret." << callCount << ")\n";
+		return;
+	}
 
-	// store numArgs in R13, returnSymbol in R14, and function name (address) in R15, then call bootstrap code
-	outputFile << "// call " + functionName + " " + to_string(numArgs) + "\n";
+	// store numArgs in R13, return address in R14, and function name (address) in R15, then call bootstrap code
 	if (numArgs > 2) {
-		outputFile << "@" + to_string(numArgs) + "\n"
+		outputBuffer << "@" << numArgs << "\n"
 			"D=A\n"
 			"@R13\n"
 			"M=D\n";
 	}
 	else {
-		outputFile << "@R13\n"
-			"M=" << to_string(std::min(1,numArgs)) << "\n";
-		if (numArgs == 2) outputFile << "M=M+1\n";
+		outputBuffer << "@R13\n"
+			"M=" << std::min(1,numArgs) << "\n";
+		if (numArgs == 2) outputBuffer << "M=M+1\n";
 	}
 		
-	outputFile << "@" + returnSymbol + "\n"
+	outputBuffer << "@" << funcPrefix << currFunction << "$ret." << callCount << "\n"
 		"D=A\n"
 		"@R14\n"
 		"M=D\n"
-		"@" + funcPrefix + functionName + "\n"
+		"@" << funcPrefix << functionName << "\n"
 		"D=A\n"
 		"@R15\n"
 		"M=D\n"
 		"@__CallBootstrap__\n"
 		"0;JMP\n"
-		"(" + returnSymbol + ")\n";
+		"(" << funcPrefix << currFunction << "$ret." << callCount << ")\n";
 }
 
 void CodeWriter::writeCallBootstrap() {
-	const string saveVar = "D=M\n"
+	constexpr string_view saveVar = "D=M\n"
 		"@SP\n"
 		"M=M+1\n"
 		"A=M-1\n"
 		"M=D\n";
 
-	outputFile << "(__CallBootstrap__)\n"
+	outputBuffer << "(__CallBootstrap__)\n"
 		"@SP\n" // at point function is called, SP will be pointing to return address spot. This spot - numArgs will be arg0. Which means if numArgs = 0, they will be in the same spot! This case is handled in the return function
 		"A=M\n"
 		"D=A\n"
@@ -371,13 +832,13 @@ void CodeWriter::writeCallBootstrap() {
 		"@SP\n"
 		"M=M+1\n" // advance SP then begin to save frame
 		"@LCL\n"
-		+ saveVar +
+		<< saveVar <<
 		"@ARG\n"
-		+ saveVar +
+		<< saveVar <<
 		"@THIS\n"
-		+ saveVar +
+		<< saveVar <<
 		"@THAT\n"
-		+ saveVar +
+		<< saveVar <<
 		"@R13\n"
 		"D=M\n"
 		"@ARG\n"
@@ -389,7 +850,7 @@ void CodeWriter::writeCallBootstrap() {
 
 void CodeWriter::writeReturnBootstrap() {
 	// restore saved frame, starting with THAT
-	outputFile << "(__ReturnBootstrap__)\n"
+	outputBuffer << "(__ReturnBootstrap__)\n"
 		"@LCL\n"
 		"A=M-1\n"
 		"D=M\n"
@@ -446,24 +907,402 @@ void CodeWriter::writeReturnBootstrap() {
 		"0;JMP\n";
 }
 
+void CodeWriter::writeCompareBootstrap() {
+	// x and y are on the stack and the return address is in D. The result replaces x,
+	// so the routines behave exactly like the inline comparison.
+	for (Arith command : { Arith::EQ, Arith::GT, Arith::LT }) {
+		const char* name = (command == Arith::EQ ? "EQ" : command == Arith::GT ? "GT" : "LT");
+		outputBuffer << "(__Compare" << name << "__)\n"
+			"@R14\n"
+			"M=D\n"
+			"@SP\n"
+			"AM=M-1\n"
+			"D=M\n"
+			"A=A-1\n"
+			"D=M-D\n"
+			"M=-1\n" // start with assumption the result is true
+			"@__Compare" << name << "True__\n"
+			"D;J" << name << "\n"
+			"@SP\n"
+			"A=M-1\n"
+			"M=0\n"
+			"(__Compare" << name << "True__)\n"
+			"@R14\n"
+			"A=M\n"
+			"0;JMP\n";
+	}
+}
+
+void CodeWriter::writeSharedCompare(Arith command)
+{
+	settleStack();
+	const char* name = (command == Arith::EQ ? "EQ" : command == Arith::GT ? "GT" : "LT");
+	outputBuffer << "// " << arithNames[static_cast<int>(command)] << " (shared)\n"
+		"@" << funcPrefix << currFunction << "$COMPARE_RET$" << arithCount << "\n"
+		"D=A\n"
+		"@__Compare" << name << "__\n"
+		"0;JMP\n"
+		"(" << funcPrefix << currFunction << "$COMPARE_RET$" << arithCount << ")\n";
+	++arithCount;
+}
+
 void CodeWriter::writeReturn()
 {
-	outputFile << "// return\n"
-		"@__ReturnBootstrap__\n"
+	settleStack();
+	if (currStatic) {
+		outputBuffer << "// return\n";
+		if (currStatic->savePointers) outputBuffer << "@" << currStatic->returnSlot() + 1 << "\n"
+			"D=M\n"
+			"@THIS\n"
+			"M=D\n"
+			"@" << currStatic->returnSlot() + 2 << "\n"
+			"D=M\n"
+			"@THAT\n"
+			"M=D\n";
+		outputBuffer << "@" << currStatic->returnSlot() << "\n"
+			"A=M\n"
+			"0;JMP\n";
+		return;
+	}
+	outputBuffer << "// return\n"
+		"@" << (currShape >= 0 ? leaveStub(frames->shapes[currShape]) : "__ReturnBootstrap__") << "\n"
 		"0;JMP\n";
 }
 
+void CodeWriter::writeFrameStubs() {
+	constexpr string_view pushD = "@SP\n"
+		"AM=M+1\n"
+		"A=A-1\n"
+		"M=D\n";
+	set<string> written;
+	for (const FrameShape& shape : frames->shapes) {
+		// Entry: the return address is in D and the function's address in R15.
+		// The frame is the return address, [LCL,] ARG[, THIS, THAT].
+		const int frameSize = 2 + shape.saveLocal + 2 * shape.savePointers;
+		outputBuffer << "(" << enterStub(shape) << ")\n" << pushD;
+		if (shape.saveLocal) outputBuffer << "@LCL\n"
+			"D=M\n" << pushD;
+		outputBuffer << "@ARG\n"
+			"D=M\n" << pushD;
+		if (shape.savePointers) outputBuffer << "@THIS\n"
+			"D=M\n" << pushD << "@THAT\n"
+			"D=M\n" << pushD;
+		outputBuffer << "@SP\n"
+			"D=M\n";
+		if (shape.saveLocal) outputBuffer << "@LCL\n"
+			"M=D\n";
+		outputBuffer << "@" << frameSize + shape.numArgs << "\n"
+			"D=D-A\n"
+			"@ARG\n"
+			"M=D\n";
+		if (shape.numLocals > 0) {
+			outputBuffer << "@SP\n"
+				"A=M\n"
+				"M=0\n";
+			for (int i = 1; i < shape.numLocals; ++i) outputBuffer << "A=A+1\n"
+				"M=0\n";
+			outputBuffer << "D=A+1\n"
+				"@SP\n"
+				"M=D\n";
+		}
+		outputBuffer << "@R15\n"
+			"A=M\n"
+			"0;JMP\n";
+
+		const string leave = leaveStub(shape);
+		if (!written.insert(leave).second) continue;
+		// Exit: R13 holds the frame's base, where the return address was saved
+		outputBuffer << "(" << leave << ")\n";
+		if (shape.saveLocal) outputBuffer << "@" << frameSize << "\n"
+			"D=A\n"
+			"@LCL\n"
+			"D=M-D\n";
+		else outputBuffer << "@" << shape.numArgs << "\n"
+			"D=A\n"
+			"@ARG\n"
+			"D=M+D\n";
+		outputBuffer << "@R13\n"
+			"AM=D\n"
+			"D=M\n"
+			"@R14\n"
+			"M=D\n"; // return address
+		if (shape.savePointers) {
+			const int pointers = 2 + shape.saveLocal;
+			outputBuffer << "@R13\n"
+				"D=M\n"
+				"@" << pointers << "\n"
+				"A=D+A\n"
+				"D=M\n"
+				"@THIS\n"
+				"M=D\n"
+				"@R13\n"
+				"D=M\n"
+				"@" << pointers + 1 << "\n"
+				"A=D+A\n"
+				"D=M\n"
+				"@THAT\n"
+				"M=D\n";
+		}
+		// copy the return value to arg 0 and reset the stack pointer after it
+		outputBuffer << "@SP\n"
+			"A=M-1\n"
+			"D=M\n"
+			"@ARG\n"
+			"A=M\n"
+			"M=D\n"
+			"D=A+1\n"
+			"@SP\n"
+			"M=D\n";
+		if (shape.saveLocal) outputBuffer << "@R13\n"
+			"A=M+1\n"
+			"D=M\n"
+			"@LCL\n"
+			"M=D\n";
+		outputBuffer << "@R13\n"
+			"A=M+1\n" << (shape.saveLocal ? "A=A+1\n" : "") << "D=M\n"
+			"@ARG\n"
+			"M=D\n"
+			"@R14\n"
+			"A=M\n"
+			"0;JMP\n";
+	}
+}
+
 void CodeWriter::writeComment(const string& comment) {
-	outputFile << "// " << comment << endl; // double set of "//" will indicate comments from vm file
+	outputBuffer << "// " << comment << "\n"; // double set of "//" will indicate comments from vm file
+}
+
+void CodeWriter::translate(const VMProgram& program, const VMFunction& function)
+{
+	setFilename(program.files[function.file]);
+	names = &program.names;
+	if (function.name < 0) {
+		currShape = -1;
+		currStatic = nullptr;
+	}
+	if (function.name >= 0) {
+		writeFunction(program.names[function.name], function.numVars);
+	}
+
+	const vector<VMInstruction>& code = program.code;
+	for (size_t i = function.begin; i < function.end; ++i) {
+		const VMInstruction& instruction = code[i];
+		switch (instruction.command) {
+			case Command::COMMENT:
+				writeComment(program.comments[instruction.name]);
+				break;
+			case Command::C_RETURN:
+				writeReturn();
+				break;
+			case Command::C_ARITHMETIC: {
+				// eq/gt/lt and not in front of an if-goto are folded into the jump
+				const bool isCompare = (instruction.arith == Arith::EQ || instruction.arith == Arith::GT || instruction.arith == Arith::LT);
+				if (isCompare && foldsIntoBranch(code, i, function.end)) {
+					const bool negate = (code[i + 1].command == Command::C_ARITHMETIC);
+					i += negate ? 2 : 1;
+					writeCompareIf(instruction.arith, negate, program.names[code[i].name]);
+				}
+				else if (instruction.arith == Arith::NOT && i + 1 < function.end && code[i + 1].command == Command::C_IF) {
+					++i;
+					writeCompareIf(Arith::NONE, true, program.names[code[i].name]);
+				}
+				else if (isCompare && sharedCompares && (*sharedCompares)[i]) {
+					writeSharedCompare(instruction.arith);
+				}
+				else {
+					writeArithmetic(instruction.arith);
+				}
+				break;
+			}
+			case Command::C_GOTO:
+				writeGoto(program.names[instruction.name]);
+				break;
+			case Command::C_IF:
+				writeIf(program.names[instruction.name]);
+				break;
+			case Command::C_LABEL:
+				writeLabel(program.names[instruction.name]);
+				break;
+			case Command::C_PUSH:
+				if (i + 1 < function.end && code[i + 1].command == Command::C_POP) {
+					writePush(instruction.segment, instruction.index, true, instruction.name);
+					writePop(code[i + 1].segment, code[i + 1].index, true, code[i + 1].name);
+					++i;
+				}
+				else {
+					writePush(instruction.segment, instruction.index, false, instruction.name);
+				}
+				break;
+			case Command::C_POP:
+				writePop(instruction.segment, instruction.index, false, instruction.name);
+				break;
+			case Command::C_CALL:
+				writeCall(program.names[instruction.name], instruction.index);
+				break;
+			default:
+				break;
+		}
+	}
+	settleStack();
+}
+
+void CodeWriter::translate(const VMProgram& program, const std::vector<int>& selected, int jobs)
+{
+	// Labels are the only state shared between pieces of code: the comparison and return
+	// address counters of the enclosing function, which code outside of any function
+	// continues. Both are derived from the instructions up front so that every function
+	// can be translated independently and still get exactly the labels a sequential run
+	// would give it.
+	const size_t count = selected.size();
+	vector<int> arithBase(count);
+	vector<int> callBase(count);
+	vector<string> enclosing(count);
+	string current = currFunction;
+	for (size_t k = 0; k < count; ++k) {
+		const VMFunction& function = program.functions[selected[k]];
+		if (function.name >= 0) {
+			current = program.names[function.name];
+			arithCount = 0;
+		}
+		enclosing[k] = current; // code outside of any function keeps the previous function's labels
+		arithBase[k] = arithCount;
+		int& calls = functionCallCount[current];
+		callBase[k] = calls;
+		for (size_t i = function.begin; i < function.end; ++i) {
+			const VMInstruction& instruction = program.code[i];
+			if (instruction.command == Command::C_CALL) ++calls;
+			else if (instruction.arith == Arith::EQ || instruction.arith == Arith::GT || instruction.arith == Arith::LT) ++arithCount;
+		}
+	}
+	if (!count) return;
+	currFunction = enclosing.back();
+
+	vector<AsmBuffer> buffers(count);
+	atomic<size_t> next = 0;
+	atomic<int> reused = 0;
+	auto worker = [&]() {
+		for (size_t k = next++; k < count; k = next++) {
+			const VMFunction& function = program.functions[selected[k]];
+			uint64_t key = 0;
+			if (cache) {
+				key = fragmentKey(program, function, enclosing[k], arithBase[k], callBase[k]);
+				string cached;
+				buffers[k].setEncoding(outputBuffer.encoding());
+				if (cache->load(key, cached) && buffers[k].restore(cached)) {
+					++reused;
+					continue;
+				}
+			}
+			CodeWriter fragment;
+			fragment.inheritSettings(*this);
+			fragment.currFunction = enclosing[k];
+			fragment.arithCount = arithBase[k];
+			if (callBase[k]) fragment.functionCallCount.emplace(enclosing[k], callBase[k]);
+			fragment.outputBuffer.reserve((function.end - function.begin) * 64); // typical asm size per VM command
+			fragment.translate(program, function);
+			if (cache) cache->store(key, fragment.outputBuffer.save());
+			buffers[k] = std::move(fragment.outputBuffer);
+		}
+	};
+
+	jobs = std::clamp(jobs, 1, static_cast<int>(count));
+	vector<thread> pool;
+	for (int i = 1; i < jobs; ++i) pool.emplace_back(worker);
+	worker();
+	for (auto& t : pool) t.join();
+	if (cache) {
+		cout << "Reused " << reused << " of " << count << " functions from the cache." << endl;
+	}
+
+	size_t total = outputBuffer.size();
+	for (auto& buffer : buffers) total += buffer.size();
+	outputBuffer.reserve(total);
+	for (auto& buffer : buffers) outputBuffer << std::move(buffer);
+}
+
+void CodeWriter::setCache(const BuildCache* buildCache)
+{
+	cache = buildCache;
+}
+
+void CodeWriter::setDirectEncoding(bool enabled)
+{
+	outputBuffer.setEncoding(enabled);
+}
+
+uint64_t CodeWriter::fragmentKey(const VMProgram& program, const VMFunction& function, const string& enclosing, int arithBase, int callBase) const
+{
+	// Everything the translation of one function reads: its commands and names, the file
+	// its statics belong to, where its labels start and the settings that change its code.
+	// The frames of the functions it calls matter too, since call sites depend on them.
+	uint64_t key = BuildCache::hash(translatorVersion);
+	key = BuildCache::hash(program.files[function.file], key);
+	key = BuildCache::hash(enclosing, key);
+	key = BuildCache::hash(arithBase, key);
+	key = BuildCache::hash(callBase, key);
+	key = BuildCache::hash(cacheTop | deferSP << 1 | outputBuffer.encoding() << 2, key); // encoded entries are not assembly
+	key = BuildCache::hash(function.name >= 0 ? program.names[function.name] : string(), key);
+	key = BuildCache::hash(function.numVars, key);
+	auto hashFrame = [&](const string& name) {
+		int shape = shapeOf(name);
+		if (shape >= 0) {
+			const FrameShape& frame = frames->shapes[shape];
+			key = BuildCache::hash(enterStub(frame), key);
+			key = BuildCache::hash(leaveStub(frame), key);
+		}
+		if (const StaticFrame* frame = staticFrameOf(name)) {
+			key = BuildCache::hash(frame->base, key);
+			key = BuildCache::hash(frame->numArgs, key);
+			key = BuildCache::hash(frame->numLocals, key);
+			key = BuildCache::hash(frame->savePointers, key);
+		}
+		key = BuildCache::hash(-1, key);
+	};
+	if (function.name >= 0) hashFrame(program.names[function.name]);
+	for (size_t i = function.begin; i < function.end; ++i) {
+		const VMInstruction& instruction = program.code[i];
+		key = BuildCache::hash(static_cast<int>(instruction.command) | static_cast<int>(instruction.arith) << 8 | static_cast<int>(instruction.segment) << 16, key);
+		key = BuildCache::hash(instruction.index, key);
+		if (instruction.command == Command::COMMENT) {
+			key = BuildCache::hash(program.comments[instruction.name], key);
+		}
+		else if (instruction.name >= 0) {
+			key = BuildCache::hash(program.names[instruction.name], key);
+		}
+		if (instruction.command == Command::C_CALL) hashFrame(program.names[instruction.name]);
+		if (sharedCompares) key = BuildCache::hash((*sharedCompares)[i], key);
+	}
+	return key;
+}
+
+int CodeWriter::applyPeephole(const PeepholeRules& rules)
+{
+	int numRewrites = 0;
+	string rewritten = rules.apply(outputBuffer.view(), numRewrites);
+	outputBuffer.clear();
+	outputBuffer << rewritten;
+	return numRewrites;
+}
+
+void CodeWriter::flush(ostream& out)
+{
+	out.write(outputBuffer.begin(), outputBuffer.size());
+	outputBuffer.clear();
 }
 
 void CodeWriter::close()
 {
 	if (outputFile.is_open()) {
+		outputFile.write(outputBuffer.begin(), outputBuffer.size());
 		outputFile.close();
 	}
 }
 
+const AsmBuffer& CodeWriter::output() const
+{
+	return outputBuffer;
+}
+
 CodeWriter::~CodeWriter()
 {
 }
@@ -1,27 +1,91 @@
 #pragma once
 #include <string>
 #include <fstream>
-#include <set>
+#include <vector>
 #include <map>
+#include <unordered_map>
 #include "Shared.h"
+#include "Parser.h"
+#include "AsmBuffer.h"
+#include "PeepholeRules.h"
+#include "BuildCache.h"
+#include "ProgramAnalysis.h"
 constexpr int TEMP_START = 5;
+constexpr int STACK_BASE = 256;
 
-enum class Segment { CONST = 0, ARG, LOCAL, STATIC, THIS, THAT, POINTER, TEMP, NONE };
+// Calling convention of a function whose callers all pass the same number of arguments.
+// Each distinct shape gets its own entry and exit stub instead of the generic bootstraps.
+struct FrameShape {
+	int numArgs = 0;
+	int numLocals = 0;
+	bool saveLocal = true;    // LCL is saved and set; not needed by leaves without locals
+	bool savePointers = true; // THIS/THAT are saved; not needed when the function never pops to pointer
+	auto operator<=>(const FrameShape&) const = default;
+};
+
+// Fixed RAM for a function that can never be re-entered. The function pops its arguments
+// into it on entry and reaches its arguments and locals with a direct @addr.
+struct StaticFrame {
+	int base = 0; // arguments, then locals, the return address and the saved THIS/THAT
+	int numArgs = 0;
+	int numLocals = 0;
+	bool savePointers = false;
+	int returnSlot() const { return base + numArgs + numLocals; }
+	int size() const { return numArgs + numLocals + 1 + 2 * savePointers; }
+};
+
+struct FrameLayout {
+	std::vector<FrameShape> shapes;
+	std::unordered_map<std::string, int> shapeOf; // function name to shape; others use the generic frame
+	std::unordered_map<std::string, StaticFrame> staticFrames;
+	int staticRegionSize = 0; // the stack starts after the static frames
+};
 
 class CodeWriter
 {
 public:
 	CodeWriter(const std::string& filename); // open output file
-	
-	void writeArithmetic(const std::string& command);
-	void writePush(const std::string& segment, int index, bool beforePop = false);
-	void writePop(const std::string& segment, int index, bool afterPush = false);
+	CodeWriter(); // writes only to its buffer, read with output()
+
+	void translate(const VMProgram& program, const VMFunction& function);
+	// Translates the selected functions on up to jobs threads and appends them in order
+	void translate(const VMProgram& program, const std::vector<int>& selected, int jobs);
+
+	void writeArithmetic(Arith command);
+	// name is the variable for Segment::NAMED and ignored otherwise
+	void writePush(Segment segment, int index, bool beforePop = false, int name = -1);
+	void writePop(Segment segment, int index, bool afterPush = false, int name = -1);
 
 	void setFilename(const std::string& filename);
+	void setTopOfStackCaching(bool enabled);
+	// Within a basic block, stack slots are addressed from the SP the block started with and
+	// SP is written back once, before labels, jumps, calls and returns
+	void setDeferredStackPointer(bool enabled);
+	// Comparisons at the marked instruction indices call the shared __Compare*__ routines
+	void setSharedCompares(const std::vector<bool>* sites);
+	// Whether a comparison through the shared routines takes fewer instructions than inline.
+	// With the top of the stack in D it does not: the inline comparison leaves its result in D,
+	// the shared one has to spill D first and leaves the result in RAM.
+	bool sharedComparesAreSmaller() const;
+	// Size of the whole program with the current settings, bootstrap included
+	int countInstructions(const VMProgram& program, const std::vector<int>& selected, int jobs);
+	// Functions use the specialized call and return stubs of the layout (built by planFrames)
+	void setFrameLayout(const FrameLayout* layout);
+	// translate() reuses functions translated by earlier runs with the same inputs and settings
+	void setCache(const BuildCache* buildCache);
+	// Encodes each instruction into Hack words as it is written instead of keeping assembly
+	// text; output().encoded() is then the code. Set before anything is written.
+	void setDirectEncoding(bool enabled);
+	// Functions entered from outside the program (external) keep the generic frame
+	static FrameLayout planFrames(const VMProgram& program, const std::vector<int>& selected, bool useShapes, bool useStaticFrames,
+		const ExternalCalls* external = nullptr);
+	// Whether the comparison at code[i] is folded into a following (not +) if-goto
+	static bool foldsIntoBranch(const std::vector<VMInstruction>& code, size_t i, size_t end);
 	void writeInit();
 	void writeLabel(const std::string& label);
 	void writeGoto(const std::string& label);
 	void writeIf(const std::string& label);
+	void writeCompareIf(Arith compare, bool negate, const std::string& label); // compare is NONE for a lone not
 	void writeFunction(const std::string& functionName, int numVars);
 	void writeCall(const std::string& functionName, int numArgs);
 	void writeReturn();
@@ -29,22 +93,62 @@ public:
 
 	void writeReturnBootstrap();
 	void writeCallBootstrap();
+	void writeCompareBootstrap();
+	void writeFrameStubs();
+	void writeSharedCompare(Arith command);
 
+	// Rewrites the translated assembly with the superoptimizer's rules, returns the number of rewrites
+	int applyPeephole(const PeepholeRules& rules);
+
+	// Writes the buffered code to out and empties the buffer, for translating a stream piece by piece
+	void flush(std::ostream& out);
 	void close(); // close output file
+	const AsmBuffer& output() const;
 
 	~CodeWriter();
 
 private:
 	const std::string outputFilename;
 	std::string inputFilename;
+	std::string staticPrefix;
 	std::string funcPrefix;
 	std::string currFunction;
 	std::ofstream outputFile;
+	AsmBuffer outputBuffer; // written to outputFile on close()
 	std::map<std::string, int> functionCallCount;
-	static const std::set<std::string> arithCommands;
-	static const std::map<std::string, std::string> segmentMap;
 	int arithCount = 0;
-	std::string getSegmentReference(const std::string& segment, int index);
-	static const std::map<std::string, Segment> segmentEnumMap;
+	const NameTable* names = nullptr; // of the program being translated, for Segment::NAMED
+	void writeSegmentReference(Segment segment, int index, int name);
+	std::string_view segmentName(Segment segment, int name) const;
+
+	// Top-of-stack caching: the top of the VM stack may be held in D instead of RAM. The
+	// state is tracked while translating and spilled before labels, jumps, calls and
+	// returns, so every control flow edge sees the plain RAM stack.
+	bool cacheTop = false;
+	bool topInD = false;
+	bool deferSP = false;
+	int spOffset = 0; // the stack pointer is RAM[SP] + spOffset while it is deferred
+	const std::vector<bool>* sharedCompares = nullptr;
+	const FrameLayout* frames = nullptr;
+	const BuildCache* cache = nullptr;
+	uint64_t fragmentKey(const VMProgram& program, const VMFunction& function, const std::string& enclosing, int arithBase, int callBase) const;
+	int currShape = -1; // frame shape of the function being translated, -1 for the generic frame
+	int shapeOf(const std::string& functionName) const;
+	const StaticFrame* currStatic = nullptr; // static frame of the function being translated
+	const StaticFrame* staticFrameOf(const std::string& functionName) const;
+	bool isIndirect(Segment segment) const; // reached through a base pointer rather than @addr
+	static std::string enterStub(const FrameShape& shape);
+	static std::string leaveStub(const FrameShape& shape);
+	void inheritSettings(const CodeWriter& other);
+	// With sync, a deferred SP is written back as part of the spill or pop
+	void spillTop(bool sync = false);
+	void writeStackSlot(int offset); // points A at the slot offset words from the stack pointer
+	void writeStackPop(std::string_view use, bool sync = false); // pops the top of the RAM stack with A at its slot, then runs use
+	void adjustStackPointer(); // adds spOffset to RAM[SP] one step at a time, which leaves D alone
+	void flushStackPointer();
+	void settleStack(); // spills the cached top and writes back a deferred SP, so the RAM stack is exact
+	void writeCachedArithmetic(Arith command);
+	void writeCachedPush(Segment segment, int index, int name);
+	void writeCachedPop(Segment segment, int index, int name);
 };
 
@@ -0,0 +1,143 @@
+#include "CostReport.h"
+#include <iostream>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+
+using namespace std;
+
+static const char* arithNames[] = { "add", "sub", "neg", "eq", "gt", "lt", "and", "or", "not" };
+static const char* segmentNames[] = { "constant", "argument", "local", "static", "this", "that", "pointer", "temp", "named" };
+
+static string commandKind(const VMInstruction& instruction)
+{
+	switch (instruction.command) {
+	case Command::C_ARITHMETIC: return arithNames[static_cast<int>(instruction.arith)];
+	case Command::C_PUSH: return string("push ") + segmentNames[static_cast<int>(instruction.segment)];
+	case Command::C_POP: return string("pop ") + segmentNames[static_cast<int>(instruction.segment)];
+	case Command::C_LABEL: return "label";
+	case Command::C_GOTO: return "goto";
+	case Command::C_IF: return "if-goto";
+	case Command::C_FUNCTION: return "function";
+	case Command::C_RETURN: return "return";
+	case Command::C_CALL: return "call";
+	default: return string();
+	}
+}
+
+CostReport::CostReport(const VMProgram& program, const vector<int>& selected, string_view assembly)
+{
+	unordered_map<string, int> indexOf;
+	for (int f : selected) {
+		const VMFunction& function = program.functions[f];
+		if (function.name < 0) continue;
+		FunctionCost cost;
+		cost.name = program.names[function.name];
+		cost.file = program.files[function.file];
+		for (size_t i = function.begin; i < function.end; ++i) {
+			string kind = commandKind(program.code[i]);
+			if (kind.empty()) continue;
+			++cost.commands[kind];
+			++cost.numCommands;
+			if (program.code[i].command == Command::C_CALL) ++cost.numCalls;
+		}
+		indexOf.emplace(cost.name, static_cast<int>(functions.size()));
+		functions.push_back(std::move(cost));
+	}
+
+	// Instructions and labels of the bootstrap (region -1) and of each function
+	struct Region {
+		vector<string_view> code;
+		unordered_map<string_view, int> labels; // by index into code
+	};
+	Region bootstrap;
+	vector<Region> regions(functions.size());
+	Region* region = &bootstrap;
+	size_t lineStart = 0;
+	while (lineStart < assembly.size()) {
+		size_t lineEnd = assembly.find('\n', lineStart);
+		if (lineEnd == string_view::npos) lineEnd = assembly.size();
+		string_view line = assembly.substr(lineStart, lineEnd - lineStart);
+		lineStart = lineEnd + 1;
+
+		if (line.rfind("// function ", 0) == 0) {
+			string_view name = line.substr(12, line.find(' ', 12) - 12);
+			auto it = indexOf.find(string(name));
+			region = (it != indexOf.end() ? &regions[it->second] : &bootstrap);
+			continue;
+		}
+		line = line.substr(0, line.find("//"));
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == string_view::npos) continue;
+		line = line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+		if (line[0] == '(') region->labels.emplace(line.substr(1, line.size() - 2), static_cast<int>(region->code.size()));
+		else region->code.push_back(line);
+	}
+
+	// A routine runs from its label to the first unconditional jump; a comparison's worst
+	// case falls through its conditional jump
+	map<string, int> allRoutines;
+	for (auto& [label, start] : bootstrap.labels) {
+		int end = start;
+		while (end < static_cast<int>(bootstrap.code.size()) && bootstrap.code[end] != "0;JMP") ++end;
+		allRoutines.emplace(string(label), end - start + 1);
+	}
+	bootstrapSize = static_cast<int>(bootstrap.code.size());
+	totalSize = bootstrapSize;
+
+	for (size_t f = 0; f < functions.size(); ++f) {
+		const Region& code = regions[f];
+		FunctionCost& cost = functions[f];
+		cost.instructions = static_cast<int>(code.code.size());
+		cost.worstCaseCycles = cost.instructions;
+		for (size_t i = 1; i < code.code.size(); ++i) {
+			if (code.code[i].find(';') == string_view::npos || code.code[i - 1][0] != '@') continue;
+			string_view target = code.code[i - 1].substr(1);
+			if (auto routine = allRoutines.find(string(target)); routine != allRoutines.end() && code.code[i] == "0;JMP") {
+				cost.worstCaseCycles += routine->second;
+				routineCycles.insert(*routine); // only the routines functions use are reported
+			}
+			if (auto label = code.labels.find(target); label != code.labels.end() && label->second <= static_cast<int>(i)) {
+				cost.hasLoops = true;
+			}
+		}
+		totalSize += cost.instructions;
+	}
+}
+
+bool CostReport::write(const string& filename) const
+{
+	ofstream report(filename);
+	if (!report.is_open()) {
+		cout << "Error opening " << filename << " for the report" << endl;
+		return false;
+	}
+	report << "{\n"
+		"  \"instructions\": " << totalSize << ",\n"
+		"  \"bootstrap\": { \"instructions\": " << bootstrapSize << ", \"routineCycles\": {";
+	bool first = true;
+	for (auto& [label, cycles] : routineCycles) {
+		report << (first ? " " : ", ") << "\"" << label << "\": " << cycles;
+		first = false;
+	}
+	report << " } },\n"
+		"  \"functions\": [";
+	for (size_t f = 0; f < functions.size(); ++f) {
+		const FunctionCost& cost = functions[f];
+		report << (f ? ",\n" : "\n") << "    { \"name\": \"" << cost.name << "\", \"file\": \"" << cost.file << "\""
+			<< ", \"instructions\": " << cost.instructions
+			<< ", \"romShare\": " << (totalSize ? static_cast<double>(cost.instructions) / totalSize : 0.0)
+			<< ", \"worstCaseCycles\": " << cost.worstCaseCycles
+			<< ", \"hasLoops\": " << (cost.hasLoops ? "true" : "false")
+			<< ", \"calls\": " << cost.numCalls
+			<< ", \"vmCommands\": " << cost.numCommands << ", \"commands\": {";
+		bool firstKind = true;
+		for (auto& [kind, count] : cost.commands) {
+			report << (firstKind ? " " : ", ") << "\"" << kind << "\": " << count;
+			firstKind = false;
+		}
+		report << " } }";
+	}
+	report << "\n  ]\n}\n";
+	return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "Parser.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+
+// Static size and cost of each translated function, written as JSON so builds can be compared.
+// Sizes are counted on the final assembly, split at the "// function" comments the CodeWriter
+// writes. The worst case for one call runs every instruction of the body once, plus the whole
+// length of every bootstrap routine it jumps to (call, return, frame stubs and shared
+// comparisons). It does not include the functions it calls, and a body with a loop can take
+// longer, which hasLoops marks.
+class CostReport
+{
+public:
+	CostReport(const VMProgram& program, const std::vector<int>& selected, std::string_view assembly);
+	bool write(const std::string& filename) const;
+
+private:
+	struct FunctionCost {
+		std::string name;
+		std::string file;
+		std::map<std::string, int> commands; // VM commands by kind, e.g. "push constant"
+		int numCommands = 0;
+		int numCalls = 0;
+		int instructions = 0;
+		long long worstCaseCycles = 0;
+		bool hasLoops = false;
+	};
+
+	std::map<std::string, int> routineCycles; // bootstrap routines, from their label to the jump that leaves them
+	std::vector<FunctionCost> functions;      // in the order they were translated
+	int bootstrapSize = 0;
+	int totalSize = 0;
+};
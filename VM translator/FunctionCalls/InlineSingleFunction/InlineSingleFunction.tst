@@ -0,0 +1,15 @@
+// Tests InlineSingleFunction.asm on the CPU emulator.
+// This assembly file results from translating the folder with -inline 16.
+// The bootstrap code sets up the stack, so nothing is initialized here.
+
+load InlineSingleFunction.asm,
+output-file InlineSingleFunction.out,
+compare-to InlineSingleFunction.cmp,
+
+repeat 200 {
+	ticktock;
+}
+
+// Outputs the result Sys.init stores in temp 0
+output-list RAM[5]%D1.6.1;
+output;
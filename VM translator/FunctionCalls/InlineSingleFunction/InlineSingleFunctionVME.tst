@@ -0,0 +1,13 @@
+// Tests and illustrates InlineSingleFunction.vm on the VM emulator.
+
+load,  // loads all the VM files from the current folder
+output-file InlineSingleFunction.out,
+compare-to InlineSingleFunction.cmp,
+
+repeat 60 {
+	vmstep;
+}
+
+// Outputs the result Sys.init stores in temp 0
+output-list RAM[5]%D1.6.1;
+output;
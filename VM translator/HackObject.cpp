@@ -0,0 +1,339 @@
+#include "HackObject.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <bitset>
+#include <charconv>
+
+using namespace std;
+
+const map<string_view, int> predefinedSymbols = {
+	{ "SP", 0 }, { "LCL", 1 }, { "ARG", 2 }, { "THIS", 3 }, { "THAT", 4 },
+	{ "R0", 0 }, { "R1", 1 }, { "R2", 2 }, { "R3", 3 }, { "R4", 4 }, { "R5", 5 }, { "R6", 6 }, { "R7", 7 },
+	{ "R8", 8 }, { "R9", 9 }, { "R10", 10 }, { "R11", 11 }, { "R12", 12 }, { "R13", 13 }, { "R14", 14 }, { "R15", 15 },
+	{ "SCREEN", 16384 }, { "KBD", 24576 }
+};
+
+static const map<string_view, int> compCodes = {
+	{ "0",   0b0101010 }, { "1",   0b0111111 }, { "-1",  0b0111010 },
+	{ "D",   0b0001100 }, { "A",   0b0110000 }, { "M",   0b1110000 },
+	{ "!D",  0b0001101 }, { "!A",  0b0110001 }, { "!M",  0b1110001 },
+	{ "-D",  0b0001111 }, { "-A",  0b0110011 }, { "-M",  0b1110011 },
+	{ "D+1", 0b0011111 }, { "A+1", 0b0110111 }, { "M+1", 0b1110111 },
+	{ "D-1", 0b0001110 }, { "A-1", 0b0110010 }, { "M-1", 0b1110010 },
+	{ "D+A", 0b0000010 }, { "A+D", 0b0000010 }, { "D+M", 0b1000010 }, { "M+D", 0b1000010 },
+	{ "D-A", 0b0010011 }, { "D-M", 0b1010011 }, { "A-D", 0b0000111 }, { "M-D", 0b1000111 },
+	{ "D&A", 0b0000000 }, { "A&D", 0b0000000 }, { "D&M", 0b1000000 }, { "M&D", 0b1000000 },
+	{ "D|A", 0b0010101 }, { "A|D", 0b0010101 }, { "D|M", 0b1010101 }, { "M|D", 0b1010101 }
+};
+
+static const map<string_view, int> destCodes = {
+	{ "M", 1 }, { "D", 2 }, { "MD", 3 }, { "A", 4 }, { "AM", 5 }, { "AD", 6 }, { "AMD", 7 }
+};
+
+static const map<string_view, int> jumpCodes = {
+	{ "JGT", 1 }, { "JEQ", 2 }, { "JGE", 3 }, { "JLT", 4 }, { "JNE", 5 }, { "JLE", 6 }, { "JMP", 7 }
+};
+
+bool ObjectSection::assemble(string_view assembly)
+{
+	size_t lineStart = 0;
+	while (lineStart < assembly.size()) {
+		size_t lineEnd = assembly.find('\n', lineStart);
+		if (lineEnd == string_view::npos) lineEnd = assembly.size();
+		if (!assembleLine(assembly.substr(lineStart, lineEnd - lineStart))) {
+			return false;
+		}
+		lineStart = lineEnd + 1;
+	}
+	return true;
+}
+
+// Every C-instruction the tables allow, written out in full, so that encoding one is a single
+// lookup. The keys point into the strings, which live as long as the table.
+struct InstructionTable {
+	vector<string> texts;
+	unordered_map<string_view, uint16_t> words;
+	unordered_map<string_view, uint16_t> predefined;
+
+	InstructionTable() {
+		texts.reserve(compCodes.size() * (destCodes.size() + 1) * (jumpCodes.size() + 1));
+		for (auto& [comp, compCode] : compCodes) {
+			for (int dest = 0; dest <= static_cast<int>(destCodes.size()); ++dest) {
+				for (int jump = 0; jump <= static_cast<int>(jumpCodes.size()); ++jump) {
+					auto destIt = std::next(destCodes.begin(), std::max(0, dest - 1));
+					auto jumpIt = std::next(jumpCodes.begin(), std::max(0, jump - 1));
+					string& text = texts.emplace_back((dest ? string(destIt->first) + "=" : "") + string(comp) + (jump ? ";" + string(jumpIt->first) : ""));
+					words.emplace(text, static_cast<uint16_t>(0b111 << 13 | compCode << 6 | (dest ? destIt->second : 0) << 3 | (jump ? jumpIt->second : 0)));
+				}
+			}
+		}
+		predefined.insert(predefinedSymbols.begin(), predefinedSymbols.end());
+	}
+};
+
+bool ObjectSection::assembleLine(string_view line)
+{
+	static const InstructionTable table;
+
+	line = line.substr(0, line.find("//"));
+	size_t first = line.find_first_not_of(" \t\r");
+	if (first == string_view::npos) return true;
+	line = line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+
+	if (line[0] == '(') {
+		symbols.emplace_back(string(line.substr(1, line.size() - 2)), static_cast<int>(code.size()));
+	}
+	else if (line[0] == '@') {
+		string_view value = line.substr(1);
+		uint16_t word = 0;
+		if (auto [end, ec] = from_chars(value.data(), value.data() + value.size(), word); ec == errc() && end == value.data() + value.size()) {
+			code.push_back(word);
+		}
+		else if (auto it = table.predefined.find(value); it != table.predefined.end()) {
+			code.push_back(it->second);
+		}
+		else {
+			relocations.emplace_back(static_cast<int>(code.size()), string(value));
+			code.push_back(0);
+		}
+	}
+	else if (auto it = table.words.find(line); it != table.words.end()) {
+		code.push_back(it->second);
+	}
+	else {
+		cout << "Unknown instruction \"" << line << "\"";
+		if (!name.empty() || !file.empty()) cout << " in " << (name.empty() ? file : name);
+		cout << endl;
+		return false;
+	}
+	return true;
+}
+
+void ObjectSection::append(const ObjectSection& other)
+{
+	const int offset = static_cast<int>(code.size());
+	code.insert(code.end(), other.code.begin(), other.code.end());
+	for (auto& [symbol, at] : other.symbols) symbols.emplace_back(symbol, offset + at);
+	for (auto& [at, symbol] : other.relocations) relocations.emplace_back(offset + at, symbol);
+}
+
+void ObjectSection::append(ObjectSection&& other)
+{
+	const int offset = static_cast<int>(code.size());
+	code.insert(code.end(), other.code.begin(), other.code.end());
+	for (auto& [symbol, at] : other.symbols) symbols.emplace_back(std::move(symbol), offset + at);
+	for (auto& [at, symbol] : other.relocations) relocations.emplace_back(offset + at, std::move(symbol));
+}
+
+// Format: the number of words and the words in hex, then the number of labels and each label
+// with its offset, then the number of relocations and each offset with its symbol
+string ObjectSection::save() const
+{
+	ostringstream out;
+	out << code.size() << hex;
+	for (uint16_t word : code) out << ' ' << word;
+	out << dec << '\n' << symbols.size() << '\n';
+	for (auto& [symbol, offset] : symbols) out << symbol << ' ' << offset << '\n';
+	out << relocations.size() << '\n';
+	for (auto& [offset, symbol] : relocations) out << offset << ' ' << symbol << '\n';
+	return std::move(out).str();
+}
+
+bool ObjectSection::restore(string_view data)
+{
+	istringstream in{ string(data) };
+	size_t size = 0;
+	in >> size;
+	code.resize(size);
+	for (auto& word : code) in >> hex >> word >> dec;
+	in >> size;
+	symbols.resize(size);
+	for (auto& symbol : symbols) in >> symbol.first >> symbol.second;
+	in >> size;
+	relocations.resize(size);
+	for (auto& relocation : relocations) in >> relocation.first >> relocation.second;
+	return !in.fail();
+}
+
+void ObjectLibrary::add(ObjectSection section)
+{
+	const int index = static_cast<int>(contents.size());
+	for (auto& symbol : section.symbols) definitions.emplace(symbol.first, index);
+	if (std::find(sourceFiles.begin(), sourceFiles.end(), section.file) == sourceFiles.end()) sourceFiles.push_back(section.file);
+	contents.push_back(std::move(section));
+}
+
+const vector<ObjectSection>& ObjectLibrary::sections() const
+{
+	return contents;
+}
+
+const vector<string>& ObjectLibrary::files() const
+{
+	return sourceFiles;
+}
+
+int ObjectLibrary::sectionOf(const string& symbol) const
+{
+	auto it = definitions.find(symbol);
+	return it != definitions.end() ? it->second : -1;
+}
+
+// Format, one record per line:
+//   HACKLIB 1
+//   section <name> <file> <number of words>
+//   <words in hex, 16 per line>
+//   symbol <name> <offset>
+//   reloc <offset> <symbol>
+bool ObjectLibrary::write(const string& filename) const
+{
+	ofstream out(filename);
+	if (!out.is_open()) {
+		cout << "Error opening file " << filename << " for the library" << endl;
+		return false;
+	}
+	out << "HACKLIB 1\n" << hex << setfill('0');
+	for (auto& section : contents) {
+		out << "section " << section.name << " " << section.file << " " << dec << section.code.size() << hex << "\n";
+		for (size_t i = 0; i < section.code.size(); ++i) {
+			out << setw(4) << section.code[i] << ((i % 16 == 15 || i + 1 == section.code.size()) ? '\n' : ' ');
+		}
+		out << dec;
+		for (auto& [symbol, offset] : section.symbols) out << "symbol " << symbol << " " << offset << "\n";
+		for (auto& [offset, symbol] : section.relocations) out << "reloc " << offset << " " << symbol << "\n";
+		out << hex;
+	}
+	return true;
+}
+
+bool ObjectLibrary::read(const string& filename)
+{
+	ifstream in(filename);
+	string header;
+	if (!in.is_open() || !getline(in, header) || header.rfind("HACKLIB 1", 0) != 0) {
+		cout << "Error reading library " << filename << endl;
+		return false;
+	}
+	string record;
+	ObjectSection section;
+	bool inSection = false;
+	while (in >> record) {
+		if (record == "section") {
+			if (inSection) add(std::move(section));
+			section = ObjectSection();
+			size_t size = 0;
+			in >> section.name >> section.file >> size;
+			section.code.resize(size);
+			for (auto& word : section.code) in >> hex >> word >> dec;
+			inSection = true;
+		}
+		else if (record == "symbol" && inSection) {
+			auto& symbol = section.symbols.emplace_back();
+			in >> symbol.first >> symbol.second;
+		}
+		else if (record == "reloc" && inSection) {
+			auto& relocation = section.relocations.emplace_back();
+			in >> relocation.first >> relocation.second;
+		}
+		else {
+			cout << "Unexpected \"" << record << "\" in library " << filename << endl;
+			return false;
+		}
+	}
+	if (inSection) add(std::move(section));
+	return true;
+}
+
+void Linker::add(const ObjectSection& section, bool isRequired)
+{
+	sections.push_back(&section);
+	required.push_back(isRequired);
+}
+
+void Linker::require(const string& symbol)
+{
+	requiredSymbols.push_back(symbol);
+}
+
+int Linker::numLinked() const
+{
+	return linked;
+}
+
+vector<uint16_t> Linker::link()
+{
+	unordered_map<string, int> definedBy;
+	for (size_t s = 0; s < sections.size(); ++s) {
+		for (auto& symbol : sections[s]->symbols) definedBy.emplace(symbol.first, static_cast<int>(s));
+	}
+
+	// A section is pulled in once anything already in refers to one of its labels
+	vector<bool> reachable = required;
+	for (auto& symbol : requiredSymbols) {
+		auto it = definedBy.find(symbol);
+		if (it != definedBy.end()) reachable[it->second] = true;
+	}
+	vector<int> worklist;
+	for (size_t s = 0; s < sections.size(); ++s) {
+		if (reachable[s]) worklist.push_back(static_cast<int>(s));
+	}
+	while (!worklist.empty()) {
+		int s = worklist.back();
+		worklist.pop_back();
+		for (auto& relocation : sections[s]->relocations) {
+			auto it = definedBy.find(relocation.second);
+			if (it != definedBy.end() && !reachable[it->second]) {
+				reachable[it->second] = true;
+				worklist.push_back(it->second);
+			}
+		}
+	}
+
+	// Sections keep the order they were added in
+	unordered_map<string, int> addresses;
+	vector<int> base(sections.size(), -1);
+	int size = 0;
+	linked = 0;
+	for (size_t s = 0; s < sections.size(); ++s) {
+		if (!reachable[s]) continue;
+		base[s] = size;
+		for (auto& symbol : sections[s]->symbols) addresses.emplace(symbol.first, size + symbol.second);
+		size += static_cast<int>(sections[s]->code.size());
+		++linked;
+	}
+
+	vector<uint16_t> rom;
+	rom.reserve(size);
+	int nextVariable = 16;
+	for (size_t s = 0; s < sections.size(); ++s) {
+		if (!reachable[s]) continue;
+		rom.insert(rom.end(), sections[s]->code.begin(), sections[s]->code.end());
+		for (auto& [offset, symbol] : sections[s]->relocations) {
+			auto [it, isVariable] = addresses.try_emplace(symbol, nextVariable);
+			if (isVariable) ++nextVariable;
+			rom[base[s] + offset] = static_cast<uint16_t>(it->second);
+		}
+	}
+	return rom;
+}
+
+bool writeHack(const string& filename, const vector<uint16_t>& rom)
+{
+	ofstream hackFile(filename);
+	if (!hackFile.is_open()) {
+		cout << "Error occurred opening file for output." << endl;
+		return false;
+	}
+	cout << "Writing output to " << filename << endl;
+	string text;
+	text.reserve(rom.size() * 17);
+	for (uint16_t word : rom) {
+		text += bitset<16>(word).to_string();
+		text += '\n';
+	}
+	hackFile << text;
+	return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+
+// Relocatable Hack code: machine words whose symbolic A-instructions are left for the linker.
+// A library holds one section per translated function.
+struct ObjectSection {
+	std::string name; // function name, empty for a program's own code
+	std::string file; // .vm file the code was translated from
+	std::vector<uint16_t> code;
+	std::vector<std::pair<std::string, int>> symbols;     // labels defined here, by offset into code
+	std::vector<std::pair<int, std::string>> relocations; // offsets of A-instructions that load a symbol
+
+	// Encodes translated assembly, false (with a message) on an instruction it does not know
+	bool assemble(std::string_view assembly);
+	// Encodes one line of assembly: an instruction, a label, a comment or nothing
+	bool assembleLine(std::string_view line);
+	// Appends the code of another section, moving its labels and relocations along
+	void append(const ObjectSection& other);
+	void append(ObjectSection&& other);
+	// The code, labels and relocations as text and back, for keeping a section in the build cache
+	std::string save() const;
+	bool restore(std::string_view data);
+};
+
+// Sections written to and read from a text file (<dir>.hlib), kept in the order they were added
+class ObjectLibrary
+{
+public:
+	void add(ObjectSection section);
+	bool write(const std::string& filename) const;
+	bool read(const std::string& filename);
+
+	const std::vector<ObjectSection>& sections() const;
+	const std::vector<std::string>& files() const; // the .vm files the library was built from
+	int sectionOf(const std::string& symbol) const; // -1 if no section defines the symbol
+
+private:
+	std::vector<ObjectSection> contents;
+	std::vector<std::string> sourceFiles;
+	std::unordered_map<std::string, int> definitions;
+};
+
+// Lays out the sections that are reachable from the required ones, assigns RAM to the symbols
+// no section defines (static and named variables, from 16 in order of first use, as the
+// assembler does) and patches every relocation.
+class Linker
+{
+public:
+	void add(const ObjectSection& section, bool required = false);
+	void require(const std::string& symbol); // the section defining it is linked even if nothing refers to it
+	std::vector<uint16_t> link();
+	int numLinked() const;
+
+private:
+	std::vector<const ObjectSection*> sections;
+	std::vector<bool> required;
+	std::vector<std::string> requiredSymbols;
+	int linked = 0;
+};
+
+extern const std::map<std::string_view, int> predefinedSymbols;
+
+// Writes a ROM image as a .hack file, one 16-bit binary word per line
+bool writeHack(const std::string& filename, const std::vector<uint16_t>& rom);
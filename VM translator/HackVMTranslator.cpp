@@ -1,25 +1,62 @@
 #include "Parser.h"
 #include "CodeWriter.h"
+#include "Translation.h"
+#include "BuildCache.h"
+#include "HackObject.h"
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <chrono>
 #include <filesystem>
 #include <vector>
+#include <algorithm>
+#include <memory>
 
 using namespace std;
 
-static set<string> calledFunctions = { "Sys.init", "String.intValue" };
-
-// static const vector<string> osClasses = { "Array", "Keyboard", "Math", "Memory", "Output", "Screen", "String", "Sys" };
-
 int main(int argc, char *argv[])
 {
-    string fileOrDir;
-
-    if (argc > 1) {
-        fileOrDir = argv[1];
+    string fileOrDir;             // "-" translates a stream from stdin to stdout
+    TranslationOptions options;
+    bool buildingLibrary = false; // -lib: translate every function into <dir>.hlib
+    string libraryName;           // -link: take the functions the program does not define from this library
+    bool writeRom = false;        // -hack: encode straight to <dir>.hack instead of writing assembly
+    bool writeListing = false;    // -listing: also write the assembly of a .hack build, for reading
+
+    for (int i = 1; i < argc; ++i) {
+        if (options.parse(i, argc, argv)) {
+            continue;
+        }
+        string arg = argv[i];
+        if (arg == "-lib") {
+            buildingLibrary = true;
+        }
+        else if (arg == "-link" && i + 1 < argc) {
+            libraryName = argv[++i];
+        }
+        else if (arg == "-hack") {
+            writeRom = true;
+        }
+        else if (arg == "-listing") {
+            writeListing = true;
+        }
+        else {
+            fileOrDir = arg;
+        }
+    }
+    if (fileOrDir == "-") {
+        // Streaming: VM code from stdin and assembly to stdout, with messages on stderr
+        auto start = chrono::high_resolution_clock::now();
+        ios::sync_with_stdio(false);
+        streambuf* stdoutBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+        ostream assembly(stdoutBuffer);
+        bool translated = translateStream(std::cin, assembly, options);
+        auto stop = chrono::high_resolution_clock::now();
+        std::cout << "Finished VM translation in " << chrono::duration_cast<chrono::milliseconds>(stop - start).count() << "ms." << endl;
+        std::cout.rdbuf(stdoutBuffer);
+        return translated ? 0 : -1;
     }
-    else {
+    if (fileOrDir.empty()) {
         std::cout << "Enter .vm filename or directory: ";
         std::cin >> fileOrDir;
         std::cout << endl;
@@ -34,8 +71,6 @@ int main(int argc, char *argv[])
         isDirectory = true;
     }
 
-    static vector<string> os = { "Array.vm", "Keyboard.vm", "Math.vm", "Memory.vm", "Output.vm", "Screen.vm", "String.vm", "Sys.vm" };
-
     filesystem::directory_iterator dirIt;
     try {
         dirIt = filesystem::directory_iterator(isDirectory ? fileOrDir : ".");
@@ -44,6 +79,12 @@ int main(int argc, char *argv[])
         std::cout << "Invalid directory name, unable to open. Closing..." << endl;
         return -1;
     }
+    ObjectLibrary library;
+    if (!libraryName.empty() && !library.read(libraryName)) {
+        return -1;
+    }
+
+    vector<filesystem::path> userFiles;
     for (auto& p : dirIt) {
         if (!isDirectory) {
             if (p.path().filename().string() == fileOrDir) {
@@ -51,210 +92,82 @@ int main(int argc, char *argv[])
                 break;
             }
         }
-        else {
-            if (p.path().extension().string() == ".vm" && std::find(os.begin(), os.end(), p.path().filename().string()) == os.end() )
-                files.push_back(p.path());
+        else if (p.path().extension().string() == ".vm") {
+            string name = p.path().filename().string();
+            if (std::find(library.files().begin(), library.files().end(), name) != library.files().end())
+                continue; // already translated into the library
+            if (buildingLibrary || std::find(osFiles.begin(), osFiles.end(), name) == osFiles.end())
+                userFiles.push_back(p.path());
         }
     }
-
-    string outputName = fileOrDir.substr(0, fileOrDir.find_first_of(".")) + ".asm";
-    CodeWriter codeWriter(outputName);
+    std::sort(userFiles.begin(), userFiles.end()); // the same output whatever order the directory lists
     if (isDirectory) {
-        codeWriter.writeInit();
+        // OS classes are translated first, followed by the user's classes. A library is built
+        // from whatever the directory holds, and a linked one brings its own classes.
+        for (auto& osFile : osFiles) {
+            if (buildingLibrary || std::find(library.files().begin(), library.files().end(), osFile) != library.files().end()) continue;
+            filesystem::path osPath = filesystem::path(fileOrDir) / osFile;
+            if (filesystem::exists(osPath)) files.push_back(osPath);
+        }
+        files.insert(files.end(), userFiles.begin(), userFiles.end());
+    }
+
+    // A ROM build (and a linked program is one) encodes instructions as they are translated;
+    // only a listing (or -rules and -report, which read it) keeps the assembly text
+    string outputName = fileOrDir.substr(0, fileOrDir.find_first_of("."));
+    bool linking = !libraryName.empty();
+    writeRom = writeRom || linking;
+    if (options.outline && !writeRom && !buildingLibrary) {
+        std::cout << "-outline works on encoded code and only applies to .hack builds (-hack, -link)." << endl;
     }
+    unique_ptr<CodeWriter> codeWriter = (writeRom || buildingLibrary) ? make_unique<CodeWriter>() : make_unique<CodeWriter>(outputName + ".asm");
+    unique_ptr<BuildCache> cache;
+    if (options.useCache) {
+        cache = make_unique<BuildCache>((isDirectory ? filesystem::path(fileOrDir) : filesystem::path(fileOrDir).parent_path()) / ".buildcache");
+        codeWriter->setCache(cache.get());
+    }
+    codeWriter->setDirectEncoding(writeRom && !writeListing && encodesDirectly(options));
 
-    int numFunctions = 0;
+    // Every file is read and decoded exactly once; the instructions are reused for translation
+    VMProgram program;
     for (auto& file : files) {
-        std::cout << "Loading " << file.string() << " for dead code analysis" << endl;
+        std::cout << "Loading " << file.string() << endl;
         Parser parser(file.string());
         if (parser.didFailOpen()) {
             return -1;
         }
-        // std::cout << "Checking for dead code..." << endl;
-        while (parser.hasMoreCommands()) {
-            parser.advance();
-            if (parser.commandType() == Command::C_CALL) {
-                // cout << "Found call to " << parser.arg1() << endl;
-                calledFunctions.insert(parser.arg1());
-            }
-            else if (parser.commandType() == Command::C_FUNCTION) {
-                ++numFunctions;
-            }
-        }
+        parser.parse(program);
         parser.close();
     }
-    
-    int loopNums = 0;
-    // std::cout << "User files loop" << endl;
-    while (true) {
-        ++loopNums;
-        // std::cout << "~~~~~~~~~~~~~~~~~~~~" << endl << "Loop " << loopNums << endl;
-        int newCalledFunctions = 0;
-        for (auto& file : files) {
-            // std::cout << "Loading " << file.string() << " for dead code analysis" << endl;
-            Parser parser(file.string());
-            if (parser.didFailOpen()) {
-                return -1;
-            }
-            // std::cout << "Checking for dead code..." << endl;
-            bool inCalledFunction = false;
-            while (parser.hasMoreCommands()) {
-                parser.advance();
-                if (parser.commandType() == Command::C_RETURN) {
-                    inCalledFunction = false;
-                }
-                else if (parser.commandType() == Command::C_FUNCTION) {
-                    inCalledFunction = calledFunctions.find(parser.arg1()) != calledFunctions.end();
-                }
-                else if (parser.commandType() == Command::C_CALL && inCalledFunction) {
-                    if (calledFunctions.find(parser.arg1()) == calledFunctions.end()) {
-                        calledFunctions.insert(parser.arg1());
-                        // std::cout << "Adding " << parser.arg1() << " to called functions list" << endl;
-                        ++newCalledFunctions;
-                    }
-                }
-            }
-            parser.close();
-        }
-        if (newCalledFunctions == 0) break;
-    }
-    // std::cout << endl << "Entering OS analysis loop" << endl;
-    loopNums = 0;
-    
-    while (true) {
-        ++loopNums;
-        // std::cout << "~~~~~~~~~~~~~~~~~~~~" << endl << "Loop " << loopNums << endl;
-        int newCalledFunctions = 0;
-        for (auto& osFile : os) {
-            // std::cout << "Loading " << file.string() << " for dead code analysis" << endl;
-            Parser parser(fileOrDir + "\\" + osFile);
-            if (parser.didFailOpen()) {
-                return -1;
-            }
-            // std::cout << "Checking for dead code..." << endl;
-            bool inCalledFunction = false;
-            while (parser.hasMoreCommands()) {
-                parser.advance();
-                if (parser.commandType() == Command::C_RETURN) {
-                    inCalledFunction = false;
-                }
-                else if (parser.commandType() == Command::C_FUNCTION) {
-                    if (loopNums == 1) ++numFunctions;
-                    inCalledFunction = calledFunctions.find(parser.arg1()) != calledFunctions.end();
-                }
-                else if (parser.commandType() == Command::C_CALL && inCalledFunction) {
-                    if (calledFunctions.find(parser.arg1()) == calledFunctions.end()) {
-                        calledFunctions.insert(parser.arg1());
-                        // std::cout << "Adding " << parser.arg1() << " to called functions list" << endl;
-                        ++newCalledFunctions;
-                    }
-                    
-                }
-            }
-            parser.close();
+
+    if (buildingLibrary) {
+        ObjectLibrary built;
+        if (!buildLibrary(program, options, built) || !built.write(outputName + ".hlib")) {
+            return -1;
         }
-        if (newCalledFunctions == 0) break;
+        std::cout << "Wrote " << built.sections().size() << " functions to " << outputName << ".hlib" << endl;
+        return 0;
     }
-    std::cout << "Completed dead code analysis. Out of " << numFunctions << " functions, only " << calledFunctions.size() << " are called." << endl;
-    
-    if (isDirectory) {
-        std::for_each(os.begin(), os.end(), [&](auto& file) { file = fileOrDir + "\\" + file; });
-        std::for_each(files.begin(), files.end(), [](auto& file) { os.push_back(file.string()); });
-    }
-    else {
-        os.clear();
-        std::for_each(files.begin(), files.end(), [](auto& file) { os.push_back(file.string()); });
+
+    if (!translateProgram(program, isDirectory, options, *codeWriter, linking ? &library : nullptr)) {
+        return -1;
     }
-    
 
-    for (auto& file : os) {
-        std::cout << "Loading " << file << " for translation" << endl;
-        Parser parser(file);
-        if (parser.didFailOpen()) {
+    if (writeRom) {
+        vector<uint16_t> rom;
+        if (!encodeProgram(*codeWriter, fileOrDir, options, linking ? &library : nullptr, rom) || !writeHack(outputName + ".hack", rom)) {
             return -1;
         }
-        codeWriter.setFilename(file.substr(file.find_last_of("\\") + 1));
-
-        bool doNotAdvance = false;
-        while (parser.hasMoreCommands()) {
-            if (!doNotAdvance) parser.advance();
-            else doNotAdvance = !doNotAdvance;
-            if (parser.currCommandType == Command::C_RETURN) {
-                codeWriter.writeReturn();
-                continue;
-            }
-            else if (parser.currCommandType == Command::COMMENT) {
-                codeWriter.writeComment(parser.getCurrLine());
-                continue;
-            }
-            const string arg1 = std::move(parser.arg1());
-
-            switch (parser.currCommandType) {
-                case Command::C_ARITHMETIC:
-                    codeWriter.writeArithmetic(arg1);
-                    continue;
-                case Command::C_GOTO:
-                    codeWriter.writeGoto(arg1);
-                    continue;
-                case Command::C_IF:
-                    codeWriter.writeIf(arg1);
-                    continue;
-                case Command::C_LABEL:
-                    codeWriter.writeLabel(arg1);
-                    continue;
-            }
-
-            int arg2 = parser.arg2();
-            if (arg2 != NAN) {
-                switch (parser.currCommandType) {
-                    case Command::C_PUSH:
-                        parser.advance();
-                        if (parser.currCommandType == Command::C_POP) {
-                            codeWriter.writePush(arg1, arg2, true);
-                            codeWriter.writePop(parser.arg1(), parser.arg2(), true);
-                        }
-                        else {
-                            codeWriter.writePush(arg1, arg2);
-                            doNotAdvance = true;
-                        }
-                        break;
-                    case Command::C_POP:
-                        codeWriter.writePop(arg1, arg2);
-                        break;
-                    case Command::C_CALL:
-                        codeWriter.writeCall(arg1, arg2);
-                        break;
-                    case Command::C_FUNCTION:
-                        // cout << "Checking function " << arg1 << "..." ;
-                        if (calledFunctions.find(arg1) != calledFunctions.end()) {
-                            // cout << "Found!" << endl;
-                            codeWriter.writeFunction(arg1, arg2);
-                        }
-                        else {
-                            // cout << "Function " << arg1 << " not found in calledFunctions list" << endl;
-                            
-                            //if (arg1.substr(0, arg1.find_first_of(".")) != "Screen") {
-                                while (parser.currCommandType != Command::C_RETURN) {
-                                    // cout << "Skipping command " << parser.getCurrLine() << endl;
-                                    parser.advance();
-                               }
-                            //}
-                            //else {
-                            //    codeWriter.writeFunction(arg1, arg2);
-                            //}
-                            
-                        }
-                        break;
-                }
-            }
+        if (writeListing) {
+            ofstream listing(outputName + ".asm");
+            listing << codeWriter->output().view();
+            std::cout << "Wrote the listing to " << outputName << ".asm" << endl;
         }
-        parser.close();
     }
+
     auto stop = chrono::high_resolution_clock::now();
     auto duration = chrono::duration_cast<chrono::milliseconds>(stop - start);
     std::cout << "Finished VM translation in " << duration.count() << "ms." << endl;
 
-    
-    codeWriter.close();
-
+    codeWriter->close();
 }
@@ -0,0 +1,154 @@
+#include "Inliner.h"
+#include "ProgramAnalysis.h"
+#include <string>
+#include <algorithm>
+#include <filesystem>
+
+using namespace std;
+
+Inliner::Inliner(VMProgram& program): program(program)
+{
+}
+
+int Inliner::comment(const string& text)
+{
+	program.comments.push_back(text);
+	return static_cast<int>(program.comments.size()) - 1;
+}
+
+void Inliner::expand(const VMInstruction& call, const VMFunction& callee, const Candidate& candidate, int site, vector<VMInstruction>& code)
+{
+	const string& calleeName = program.names[callee.name];
+	const string sitePrefix = calleeName + "$" + to_string(site);
+	auto variable = [](Command command, Segment segment, int index, int name = -1) {
+		VMInstruction instruction;
+		instruction.command = command;
+		instruction.segment = segment;
+		instruction.index = index;
+		instruction.name = name;
+		return instruction;
+	};
+
+	code.push_back({ Command::COMMENT, Arith::NONE, Segment::NONE, 0, comment("call " + calleeName + " " + to_string(call.index) + " (inlined)") });
+	for (int k = call.index - 1; k >= 0; --k) {
+		code.push_back(variable(Command::C_POP, Segment::NAMED, k, candidate.argName));
+	}
+	for (int k = 0; k < callee.numVars; ++k) {
+		code.push_back(variable(Command::C_PUSH, Segment::CONST, 0));
+		code.push_back(variable(Command::C_POP, Segment::NAMED, k, candidate.localName));
+	}
+	for (int p = 0; p < 2; ++p) {
+		if (!candidate.writesPointer[p]) continue;
+		code.push_back(variable(Command::C_PUSH, Segment::POINTER, p));
+		code.push_back(variable(Command::C_POP, Segment::NAMED, p, candidate.savedName));
+	}
+
+	size_t last = callee.end;
+	while (last > callee.begin && program.code[last - 1].command == Command::COMMENT) --last;
+
+	const int endLabel = program.names.intern(sitePrefix);
+	bool jumpsToEnd = false;
+	for (size_t i = callee.begin; i < callee.end; ++i) {
+		VMInstruction instruction = program.code[i];
+		switch (instruction.command) {
+			case Command::C_PUSH:
+			case Command::C_POP:
+				if (instruction.segment == Segment::ARG) instruction.name = candidate.argName;
+				else if (instruction.segment == Segment::LOCAL) instruction.name = candidate.localName;
+				else if (instruction.segment == Segment::STATIC) instruction.name = candidate.staticName;
+				else break;
+				instruction.segment = Segment::NAMED;
+				break;
+			case Command::C_LABEL:
+			case Command::C_GOTO:
+			case Command::C_IF:
+				instruction.name = program.names.intern(sitePrefix + "$" + program.names[instruction.name]);
+				break;
+			case Command::C_RETURN:
+				if (i + 1 == last) continue; // falls through to the caller
+				instruction = { Command::C_GOTO, Arith::NONE, Segment::NONE, 0, endLabel };
+				jumpsToEnd = true;
+				break;
+			default:
+				break;
+		}
+		code.push_back(instruction);
+	}
+	if (jumpsToEnd) {
+		code.push_back({ Command::C_LABEL, Arith::NONE, Segment::NONE, 0, endLabel });
+	}
+
+	for (int p = 0; p < 2; ++p) {
+		if (!candidate.writesPointer[p]) continue;
+		code.push_back(variable(Command::C_PUSH, Segment::NAMED, p, candidate.savedName));
+		code.push_back(variable(Command::C_POP, Segment::POINTER, p));
+	}
+}
+
+int Inliner::run(int maxSize, const vector<long long>* siteCounts, long long minCount)
+{
+	vector<VMFunction>& functions = program.functions;
+	functionIndex.assign(program.names.size(), -1);
+	for (size_t f = 0; f < functions.size(); ++f) {
+		if (functions[f].name >= 0) functionIndex[functions[f].name] = static_cast<int>(f);
+	}
+
+	// Only leaves are inlined, so a copy never contains a call and recursion cannot occur
+	candidates.assign(functions.size(), Candidate());
+	for (size_t f = 0; f < functions.size(); ++f) {
+		const VMFunction& function = functions[f];
+		if (function.name < 0 || !function.calls.empty()) continue;
+		int size = static_cast<int>(count_if(program.code.begin() + function.begin, program.code.begin() + function.end,
+			[](const VMInstruction& instruction) { return instruction.command != Command::COMMENT; }));
+		// The copy must fall through to the caller with only the return value pushed.
+		// Functions that never return (Sys.halt) gain nothing.
+		bool returns = false;
+		if (size > maxSize || !isStackBalanced(program, function, &returns) || !returns) continue;
+
+		Candidate& candidate = candidates[f];
+		candidate.eligible = true;
+		for (size_t i = function.begin; i < function.end; ++i) {
+			const VMInstruction& instruction = program.code[i];
+			if (instruction.command == Command::C_POP && instruction.segment == Segment::POINTER && instruction.index < 2) {
+				candidate.writesPointer[instruction.index] = true;
+			}
+		}
+		const string name = program.names[function.name]; // a copy, interning can move the table
+		candidate.argName = program.names.intern(name + "$arg");
+		candidate.localName = program.names.intern(name + "$local");
+		candidate.savedName = program.names.intern(name + "$saved");
+		candidate.staticName = program.names.intern(filesystem::path(program.files[function.file]).stem().string());
+	}
+
+	// Rebuild the instruction vector with the call sites expanded; the bodies are read from the old one
+	const vector<VMFunction> original = functions;
+	vector<VMInstruction> code;
+	code.reserve(program.code.size());
+	int sites = 0;
+	for (VMFunction& function : functions) {
+		const size_t begin = code.size();
+		for (size_t i = function.begin; i < function.end; ++i) {
+			const VMInstruction& instruction = program.code[i];
+			if (instruction.command == Command::C_CALL && instruction.name < static_cast<int>(functionIndex.size())) {
+				int callee = functionIndex[instruction.name];
+				bool hot = !siteCounts || (*siteCounts)[i] >= minCount;
+				if (callee >= 0 && candidates[callee].eligible && hot) {
+					expand(instruction, original[callee], candidates[callee], sites++, code);
+					continue;
+				}
+			}
+			code.push_back(instruction);
+		}
+		function.begin = begin;
+		function.end = code.size();
+
+		function.calls.clear();
+		for (size_t i = function.begin; i < function.end; ++i) {
+			if (code[i].command == Command::C_CALL) function.calls.push_back(code[i].name);
+		}
+		sort(function.calls.begin(), function.calls.end());
+		function.calls.erase(unique(function.calls.begin(), function.calls.end()), function.calls.end());
+	}
+	program.code.swap(code);
+	return sites;
+}
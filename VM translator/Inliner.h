@@ -0,0 +1,32 @@
+#pragma once
+#include "Parser.h"
+#include <vector>
+
+// Replaces calls to small leaf functions with a copy of their body. Arguments and locals
+// of the copy live in assembler variables named after the callee (Segment::NAMED), labels
+// are renamed per call site and every return becomes a jump to the end of the copy.
+class Inliner
+{
+public:
+	Inliner(VMProgram& program);
+	// Inlines functions of at most maxSize commands, returns the number of call sites. With
+	// siteCounts (by instruction), only calls that ran at least minCount times are expanded.
+	int run(int maxSize, const std::vector<long long>* siteCounts = nullptr, long long minCount = 0);
+
+private:
+	struct Candidate {
+		bool eligible = false;
+		bool writesPointer[2] = { false, false };
+		int argName = -1;    // variable holding the arguments
+		int localName = -1;  // variable holding the locals
+		int savedName = -1;  // variable holding the caller's THIS/THAT while the body runs
+		int staticName = -1; // the callee's statics, which keep their file name
+	};
+
+	VMProgram& program;
+	std::vector<Candidate> candidates; // by function index
+	std::vector<int> functionIndex;    // by name, -1 if no function has the name
+
+	void expand(const VMInstruction& call, const VMFunction& callee, const Candidate& candidate, int site, std::vector<VMInstruction>& code);
+	int comment(const std::string& text);
+};
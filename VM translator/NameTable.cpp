@@ -0,0 +1,31 @@
+#include "NameTable.h"
+
+using namespace std;
+
+int NameTable::intern(string_view name)
+{
+	auto it = ids.find(name);
+	if (it != ids.end()) {
+		return it->second;
+	}
+	int id = static_cast<int>(names.size());
+	names.emplace_back(name);
+	ids.emplace(names.back(), id);
+	return id;
+}
+
+int NameTable::find(string_view name) const
+{
+	auto it = ids.find(name);
+	return it != ids.end() ? it->second : -1;
+}
+
+const string& NameTable::operator[](int id) const
+{
+	return names[id];
+}
+
+size_t NameTable::size() const
+{
+	return names.size();
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+// Interns label and function names so that VM instructions can refer to them by id
+class NameTable
+{
+public:
+	int intern(std::string_view name);
+	int find(std::string_view name) const; // -1 if the name was never interned
+	const std::string& operator[](int id) const;
+	size_t size() const;
+
+private:
+	struct Hash {
+		using is_transparent = void;
+		size_t operator()(std::string_view name) const { return std::hash<std::string_view>()(name); }
+	};
+	std::vector<std::string> names;
+	std::unordered_map<std::string, int, Hash, std::equal_to<>> ids;
+};
@@ -0,0 +1,344 @@
+#include "Outliner.h"
+#include <string>
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <numeric>
+
+using namespace std;
+
+static constexpr int MIN_LENGTH = 5; // shorter sequences never pay for their call and return
+static const string RETURN_ADDRESS = "__OutlinedReturn__"; // a variable, placed by the linker
+
+static bool isCompute(uint16_t word) { return word & 0x8000; }
+static bool isJump(uint16_t word) { return isCompute(word) && (word & 0b111); }
+static bool readsD(uint16_t word) { return isCompute(word) && !(word & (1 << 11)); } // the ALU's x input is D unless zx is set
+static bool writesD(uint16_t word) { return isCompute(word) && (word & (1 << 4)); }
+
+static uint16_t encode(string_view instruction)
+{
+	ObjectSection encoded;
+	encoded.assemble(instruction);
+	return encoded.code[0];
+}
+
+Outliner::Outliner(ObjectSection& section): section(section)
+{
+}
+
+int Outliner::sitesReplaced() const
+{
+	return numSites;
+}
+
+int Outliner::instructionsSaved() const
+{
+	return numSaved;
+}
+
+long long Outliner::cyclesAdded() const
+{
+	return numCycles;
+}
+
+int Outliner::saving(int length, int occurrences)
+{
+	return occurrences * length - (occurrences * CALL_SIZE + length + RETURN_SIZE);
+}
+
+void Outliner::buildStream(const Profile* profile)
+{
+	const vector<uint16_t>& code = section.code;
+	const int n = static_cast<int>(code.size());
+	relocationAt.assign(n, string());
+	for (auto& [offset, symbol] : section.relocations) relocationAt[offset] = symbol;
+
+	vector<pair<int, string>> labels; // by offset
+	for (auto& [symbol, offset] : section.symbols) labels.emplace_back(offset, symbol);
+	sort(labels.begin(), labels.end());
+
+	// Count of the nearest label above each word, as Profile::instructionCounts does for commands
+	counts.assign(n, 0);
+	long long count = profile ? 1 : 0; // the bootstrap runs once
+	size_t nextLabel = 0;
+	for (int i = 0; i < n; ++i) {
+		for (; nextLabel < labels.size() && labels[nextLabel].first == i; ++nextLabel) {
+			if (profile && profile->contains(labels[nextLabel].second)) count = profile->hits(labels[nextLabel].second);
+		}
+		counts[i] = count;
+	}
+
+	// Without a profile, loops count as hot: a jump back to a label of the same function
+	// (function$label) closes a loop over the words in between. Everything such a loop calls
+	// runs on every iteration too, so the functions and routines it loads the address of (labels
+	// without a $), and in turn those they load, count as hot as a whole.
+	vector<bool> inLoop(n, false);
+	if (!profile) {
+		map<string_view, int> labelOffsets;
+		vector<int> functionAt(n, 0); // index of the function (or routine) each word belongs to
+		vector<int> functionStarts = { 0 };
+		for (auto& [offset, symbol] : labels) {
+			labelOffsets.emplace(symbol, offset);
+			if (symbol.find('$') == string::npos && offset < n && offset > functionStarts.back()) functionStarts.push_back(offset);
+		}
+		for (size_t f = 0; f < functionStarts.size(); ++f) {
+			const int end = (f + 1 < functionStarts.size() ? functionStarts[f + 1] : n);
+			fill(functionAt.begin() + functionStarts[f], functionAt.begin() + end, static_cast<int>(f));
+		}
+		for (int i = 1; i < n; ++i) {
+			const string& symbol = relocationAt[i - 1];
+			if (!isJump(code[i]) || symbol.find('$') == string::npos) continue;
+			auto target = labelOffsets.find(symbol);
+			if (target != labelOffsets.end() && target->second <= i && functionAt[target->second] == functionAt[i]) {
+				fill(inLoop.begin() + target->second, inLoop.begin() + i + 1, true);
+			}
+		}
+
+		vector<bool> hotFunction(functionStarts.size(), false);
+		vector<int> worklist;
+		auto markCallees = [&](int from, int to) {
+			for (int i = from; i < to; ++i) {
+				const string& symbol = relocationAt[i];
+				if (symbol.empty() || symbol.find('$') != string::npos) continue;
+				auto target = labelOffsets.find(symbol);
+				if (target == labelOffsets.end() || target->second >= n) continue;
+				const int f = functionAt[target->second];
+				if (!hotFunction[f]) {
+					hotFunction[f] = true;
+					worklist.push_back(f);
+				}
+			}
+		};
+		for (int i = 0; i < n; ++i) {
+			if (inLoop[i]) markCallees(i, i + 1);
+		}
+		while (!worklist.empty()) {
+			const int f = worklist.back();
+			worklist.pop_back();
+			markCallees(functionStarts[f], f + 1 < static_cast<int>(functionStarts.size()) ? functionStarts[f + 1] : n);
+		}
+		for (int i = 0; i < n; ++i) {
+			if (hotFunction[functionAt[i]]) inLoop[i] = true;
+		}
+	}
+
+	// Equal words that load the same symbol get the same token. Labels become separators and
+	// words that may not be outlined get a token of their own, so no repeat can span them.
+	map<pair<uint16_t, string>, int> tokens;
+	int nextToken = 0;
+	auto addUnique = [&](int word) {
+		stream.push_back(nextToken++);
+		wordAt.push_back(word);
+	};
+	nextLabel = 0;
+	for (int i = 0; i < n; ++i) {
+		bool labelled = false;
+		for (; nextLabel < labels.size() && labels[nextLabel].first == i; ++nextLabel) labelled = true;
+		if (labelled) addUnique(-1);
+
+		bool isHot = profile ? counts[i] >= profile->hotThreshold() : inLoop[i];
+		if (isJump(code[i]) || isHot) {
+			addUnique(i);
+			continue;
+		}
+		auto [it, isNew] = tokens.try_emplace({ code[i], relocationAt[i] }, nextToken);
+		if (isNew) ++nextToken;
+		stream.push_back(it->second);
+		wordAt.push_back(i);
+	}
+}
+
+// Picks the most profitable length of a repeat of the given length for the calling convention
+void Outliner::addCandidate(int length, const vector<int>& streamStarts, vector<Candidate>& candidates) const
+{
+	const vector<uint16_t>& code = section.code;
+	const int first = wordAt[streamStarts[0]];
+	if (isCompute(code[first])) return;
+
+	// D holds the return address on entry, so it must be written before it is read, and must
+	// be written at all so the code after the sequence sees the value it expects
+	int maxLength = length;
+	int firstWrite = -1;
+	for (int j = 0; j < length; ++j) {
+		if (firstWrite < 0 && readsD(code[first + j])) {
+			maxLength = j;
+			break;
+		}
+		if (firstWrite < 0 && writesD(code[first + j])) firstWrite = j;
+	}
+	if (firstWrite < 0) return;
+
+	auto consider = [&](int candidateLength, bool checkEach) {
+		if (candidateLength <= firstWrite || candidateLength < MIN_LENGTH) return;
+		Candidate candidate;
+		candidate.length = candidateLength;
+		int end = 0;
+		for (int start : streamStarts) {
+			int word = wordAt[start];
+			int next = word + candidateLength;
+			if (word < end) continue;
+			if (checkEach && (next >= static_cast<int>(code.size()) || isCompute(code[next]))) continue;
+			candidate.starts.push_back(word);
+			end = next;
+		}
+		candidate.saving = saving(candidateLength, static_cast<int>(candidate.starts.size()));
+		if (candidate.saving > 0) candidates.push_back(std::move(candidate));
+	};
+
+	// The whole repeat when each copy is followed by an A-instruction, and the longest prefix
+	// that the copies share the next A-instruction of
+	if (maxLength == length) consider(length, true);
+	for (int shorter = min(maxLength, length - 1); shorter > firstWrite; --shorter) {
+		if (!isCompute(code[first + shorter])) {
+			consider(shorter, false);
+			break;
+		}
+	}
+}
+
+vector<Outliner::Candidate> Outliner::findCandidates() const
+{
+	// Suffix array by prefix doubling
+	const int m = static_cast<int>(stream.size());
+	if (m < 2) return {};
+	vector<int> suffixes(m), rank(stream), next(m);
+	for (int i = 0; i < m; ++i) suffixes[i] = i;
+	for (int k = 1;; k <<= 1) {
+		auto less = [&](int a, int b) {
+			if (rank[a] != rank[b]) return rank[a] < rank[b];
+			return (a + k < m ? rank[a + k] : -1) < (b + k < m ? rank[b + k] : -1);
+		};
+		sort(suffixes.begin(), suffixes.end(), less);
+		next[suffixes[0]] = 0;
+		for (int i = 1; i < m; ++i) next[suffixes[i]] = next[suffixes[i - 1]] + less(suffixes[i - 1], suffixes[i]);
+		rank.swap(next);
+		if (rank[suffixes[m - 1]] == m - 1) break;
+	}
+
+	// Longest common prefix of each suffix with the one before it (Kasai)
+	vector<int> common(m, 0);
+	int h = 0;
+	for (int p = 0; p < m; ++p) {
+		if (rank[p] == 0) {
+			h = 0;
+			continue;
+		}
+		int q = suffixes[rank[p] - 1];
+		while (p + h < m && q + h < m && stream[p + h] == stream[q + h]) ++h;
+		common[rank[p]] = h;
+		if (h > 0) --h;
+	}
+
+	// Every run of suffixes sharing a prefix of some length is one repeat with its occurrences
+	vector<Candidate> candidates;
+	vector<pair<int, int>> open = { { 0, 0 } }; // (prefix length, first suffix)
+	auto report = [&](int length, int from, int to) {
+		if (length < MIN_LENGTH) return;
+		vector<int> starts(suffixes.begin() + from, suffixes.begin() + to + 1);
+		sort(starts.begin(), starts.end());
+		addCandidate(length, starts, candidates);
+	};
+	for (int i = 1; i <= m; ++i) {
+		int length = i < m ? common[i] : 0;
+		int from = i - 1;
+		while (length < open.back().first) {
+			from = open.back().second;
+			report(open.back().first, from, i - 1);
+			open.pop_back();
+		}
+		if (length > open.back().first) open.emplace_back(length, from);
+	}
+	return candidates;
+}
+
+void Outliner::rewrite(const vector<Candidate>& chosen)
+{
+	const vector<uint16_t>& code = section.code;
+	const int n = static_cast<int>(code.size());
+	const uint16_t loadAddress = encode("D=A"), jump = encode("0;JMP"), saveReturn = encode("M=D"), loadReturn = encode("A=M");
+
+	vector<int> startOf(n, -1); // candidate outlined at each word
+	for (size_t c = 0; c < chosen.size(); ++c) {
+		for (int start : chosen[c].starts) startOf[start] = static_cast<int>(c);
+	}
+	auto bodyName = [](size_t c) { return "__Outlined" + to_string(c) + "__"; };
+
+	ObjectSection result;
+	result.name = section.name;
+	result.file = section.file;
+	vector<int> newOffset(n + 1);
+	vector<int> numCalls(chosen.size(), 0);
+	for (int i = 0; i < n;) {
+		newOffset[i] = static_cast<int>(result.code.size());
+		if (startOf[i] < 0) {
+			if (!relocationAt[i].empty()) result.relocations.emplace_back(static_cast<int>(result.code.size()), relocationAt[i]);
+			result.code.push_back(code[i++]);
+			continue;
+		}
+		const size_t c = startOf[i];
+		const string returnLabel = bodyName(c) + "$ret." + to_string(numCalls[c]++);
+		result.relocations.emplace_back(static_cast<int>(result.code.size()), returnLabel);
+		result.code.push_back(0);
+		result.code.push_back(loadAddress);
+		result.relocations.emplace_back(static_cast<int>(result.code.size()), bodyName(c));
+		result.code.push_back(0);
+		result.code.push_back(jump);
+		result.symbols.emplace_back(returnLabel, static_cast<int>(result.code.size()));
+		numCycles += counts[i] * CYCLES_PER_RUN;
+		++numSites;
+		for (int j = 1; j < chosen[c].length; ++j) newOffset[i + j] = newOffset[i];
+		i += chosen[c].length;
+	}
+	newOffset[n] = static_cast<int>(result.code.size());
+	for (auto& [symbol, offset] : section.symbols) result.symbols.emplace_back(symbol, newOffset[offset]);
+
+	// The subroutines follow the code; nothing falls through into them
+	for (size_t c = 0; c < chosen.size(); ++c) {
+		result.symbols.emplace_back(bodyName(c), static_cast<int>(result.code.size()));
+		result.relocations.emplace_back(static_cast<int>(result.code.size()), RETURN_ADDRESS);
+		result.code.push_back(0);
+		result.code.push_back(saveReturn);
+		const int first = chosen[c].starts[0];
+		for (int j = first; j < first + chosen[c].length; ++j) {
+			if (!relocationAt[j].empty()) result.relocations.emplace_back(static_cast<int>(result.code.size()), relocationAt[j]);
+			result.code.push_back(code[j]);
+		}
+		result.relocations.emplace_back(static_cast<int>(result.code.size()), RETURN_ADDRESS);
+		result.code.push_back(0);
+		result.code.push_back(loadReturn);
+		result.code.push_back(jump);
+	}
+	numSaved = n - static_cast<int>(result.code.size());
+	section = std::move(result);
+}
+
+int Outliner::run(const Profile* profile)
+{
+	buildStream(profile);
+	vector<Candidate> candidates = findCandidates();
+
+	// Most profitable first. Once some of a repeat's copies have gone into another subroutine
+	// it is worth less, so it goes back in the queue with what is left.
+	priority_queue<Candidate> queue(candidates.begin(), candidates.end());
+	vector<bool> claimed(section.code.size(), false);
+	vector<Candidate> chosen;
+	while (!queue.empty()) {
+		Candidate candidate = queue.top();
+		queue.pop();
+		vector<int> free;
+		for (int start : candidate.starts) {
+			if (std::none_of(claimed.begin() + start, claimed.begin() + start + candidate.length, [](bool b) { return b; }))
+				free.push_back(start);
+		}
+		if (free.size() < candidate.starts.size()) {
+			candidate.starts = std::move(free);
+			candidate.saving = saving(candidate.length, static_cast<int>(candidate.starts.size()));
+			if (candidate.saving > 0) queue.push(std::move(candidate));
+			continue;
+		}
+		for (int start : candidate.starts) fill(claimed.begin() + start, claimed.begin() + start + candidate.length, true);
+		chosen.push_back(std::move(candidate));
+	}
+	if (!chosen.empty()) rewrite(chosen);
+	return static_cast<int>(chosen.size());
+}
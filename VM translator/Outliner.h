@@ -0,0 +1,52 @@
+#pragma once
+#include "HackObject.h"
+#include "Profile.h"
+#include <string>
+#include <vector>
+
+// Procedural abstraction on encoded code: a straight-line sequence that occurs several times
+// is moved into one subroutine and every copy becomes a call to it. Repeats are found with a
+// suffix array over the section's words. A call is @ret D=A @body 0;JMP; the body keeps the
+// return address in the __OutlinedReturn__ variable and jumps back through it. So a sequence
+// must start with an A-instruction, must not read D before writing it and must be followed by
+// an A-instruction (which reloads the A the return clobbered). It may not hold a label or a jump.
+class Outliner
+{
+public:
+	Outliner(ObjectSection& section);
+	// Outlines every sequence that makes the section smaller and returns the number of
+	// subroutines. With a profile, code that ran at least hotThreshold() times is left alone;
+	// without one, code inside a loop is, and so is every function a loop calls.
+	int run(const Profile* profile = nullptr);
+
+	int sitesReplaced() const;
+	int instructionsSaved() const;
+	long long cyclesAdded() const; // over the profiled run, 0 without a profile
+
+	static constexpr int CALL_SIZE = 4;   // @ret D=A @body 0;JMP
+	static constexpr int RETURN_SIZE = 5; // @__OutlinedReturn__ M=D on entry, @__OutlinedReturn__ A=M 0;JMP on exit
+	static constexpr int CYCLES_PER_RUN = CALL_SIZE + RETURN_SIZE;
+
+private:
+	struct Candidate {
+		int saving = 0;
+		int length = 0;
+		std::vector<int> starts; // word offsets, in order and not overlapping
+		bool operator<(const Candidate& other) const { return saving < other.saving; }
+	};
+
+	ObjectSection& section;
+	std::vector<std::string> relocationAt; // symbol loaded by each word, empty for none
+	std::vector<int> stream;               // one token per word, with separators around what may not be outlined
+	std::vector<int> wordAt;               // word offset of each stream token, -1 for a separator
+	std::vector<long long> counts;         // estimated executions of each word
+	int numSites = 0;
+	int numSaved = 0;
+	long long numCycles = 0;
+
+	void buildStream(const Profile* profile);
+	std::vector<Candidate> findCandidates() const;
+	void addCandidate(int length, const std::vector<int>& streamStarts, std::vector<Candidate>& candidates) const;
+	void rewrite(const std::vector<Candidate>& chosen);
+	static int saving(int length, int occurrences);
+};
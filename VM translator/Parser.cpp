@@ -3,31 +3,49 @@
 #include <iostream>
 #include <string>
 #include <algorithm>
-#include <set>
-#include <map>
+#include <charconv>
 #include <filesystem>
 
 using namespace std;
 
-static const set<string> arithCommands = { "add", "sub", "neg", "eq", "gt", "lt", "and", "or", "not" };
-static const map<string, Command> commandMap = {
-	{ "pop",      Command::C_POP },
-	{ "push",     Command::C_PUSH },
-	{ "if-goto",  Command::C_IF },
-	{ "goto",     Command::C_GOTO },
-	{ "function", Command::C_FUNCTION },
-	{ "call",     Command::C_CALL },
-	{ "return",   Command::C_RETURN },
-	{ "label",    Command::C_LABEL },
-	{ "//",       Command::COMMENT }
+struct CommandName {
+	string_view name;
+	Command command;
+	Arith arith;
 };
 
-Parser::Parser(const string& filename)
+// Ordered roughly by how often the commands appear in compiled Jack code
+static const CommandName commandNames[] = {
+	{ "push",     Command::C_PUSH,       Arith::NONE },
+	{ "pop",      Command::C_POP,        Arith::NONE },
+	{ "call",     Command::C_CALL,       Arith::NONE },
+	{ "add",      Command::C_ARITHMETIC, Arith::ADD },
+	{ "label",    Command::C_LABEL,      Arith::NONE },
+	{ "if-goto",  Command::C_IF,         Arith::NONE },
+	{ "goto",     Command::C_GOTO,       Arith::NONE },
+	{ "not",      Command::C_ARITHMETIC, Arith::NOT },
+	{ "sub",      Command::C_ARITHMETIC, Arith::SUB },
+	{ "return",   Command::C_RETURN,     Arith::NONE },
+	{ "function", Command::C_FUNCTION,   Arith::NONE },
+	{ "lt",       Command::C_ARITHMETIC, Arith::LT },
+	{ "gt",       Command::C_ARITHMETIC, Arith::GT },
+	{ "eq",       Command::C_ARITHMETIC, Arith::EQ },
+	{ "neg",      Command::C_ARITHMETIC, Arith::NEG },
+	{ "and",      Command::C_ARITHMETIC, Arith::AND },
+	{ "or",       Command::C_ARITHMETIC, Arith::OR }
+};
+
+static const string_view segmentNames[] = { "constant", "argument", "local", "static", "this", "that", "pointer", "temp" };
+
+Parser::Parser(const string& filename): filename(filename)
 {
-	vmFile.open(filename);
-	int numFunctions = 0;
+	ifstream vmFile(filename, ios::binary);
 	if (vmFile.is_open()) {
 		cout << "Opened file " << filename << endl;
+		vmFile.seekg(0, ios::end);
+		source.resize(static_cast<size_t>(vmFile.tellg()));
+		vmFile.seekg(0);
+		vmFile.read(source.data(), source.size());
 	}
 	else {
 		cout << "Error opening file " << filename << " for parsing" << endl;
@@ -35,103 +53,158 @@ Parser::Parser(const string& filename)
 	}
 }
 
-bool Parser::didFailOpen()
+Parser::Parser(const string& filename, string source): filename(filename), source(std::move(source))
 {
-	return failedOpen;
 }
 
-bool Parser::hasMoreCommands()
+bool Parser::didFailOpen()
 {
-	return vmFile.good(); // file is open and has not reached eof
+	return failedOpen;
 }
 
-void Parser::removeWhitespace(string& line) {
+string_view Parser::removeWhitespace(string_view line) {
 	// Trim left whitespace
-	size_t charsStart = line.find_first_not_of(" \t");
-	if (charsStart != string::npos)
-		line.erase(0, charsStart);
-	else { // entire line is whitespace
-		line.clear();
-		return;
+	size_t charsStart = line.find_first_not_of(" \t\r");
+	if (charsStart == string_view::npos) { // entire line is whitespace
+		return string_view();
 	}
+	line.remove_prefix(charsStart);
 
 	size_t slashPos = line.find("//");
-	if (slashPos != string::npos && slashPos > 0) { // remove inline comments only
-		line.erase(slashPos);
+	if (slashPos != string_view::npos && slashPos > 0) { // remove inline comments only
+		line = line.substr(0, slashPos);
 	}
 
 	// Trim right whitespace
-	size_t charsEnd = line.find_last_not_of(" \t");
-	if (charsEnd != string::npos)
-		line.erase(charsEnd + 1);
+	size_t charsEnd = line.find_last_not_of(" \t\r");
+	return line.substr(0, charsEnd + 1);
 }
 
-void Parser::advance()
+string_view Parser::nextWord(string_view& line)
 {
-	if (hasMoreCommands()) {
-		getline(vmFile, currLine);
-		removeWhitespace(currLine);
-		if (currLine.length() == 0) {
-			advance();
-		}
-		if (currLine.length() > 0) currCommandType = commandType();
-	}
-	else {
-		currCommandType = Command::NONE;
-		cout << "Reached end of file." << endl;
+	size_t wordStart = line.find_first_not_of(" \t");
+	if (wordStart == string_view::npos) {
+		line = string_view();
+		return line;
 	}
+	size_t wordEnd = min(line.find_first_of(" \t", wordStart), line.length());
+	string_view word = line.substr(wordStart, wordEnd - wordStart);
+	line.remove_prefix(wordEnd);
+	return word;
 }
 
-Command Parser::commandType()
+string_view Parser::functionName(string_view line)
 {
-	const string commandString = currLine.substr(0, currLine.find_first_of(" "));
-	if (arithCommands.find(commandString) != arithCommands.end()) {
-		return Command::C_ARITHMETIC;
-	}
-
-	auto foundCommand = commandMap.find(commandString);
-	if (foundCommand != commandMap.end()) {
-		return foundCommand->second;
-	}
+	line = removeWhitespace(line);
+	if (nextWord(line) != "function") return string_view();
+	return nextWord(line);
+}
 
-	else {
-		// cout << "Command " << commandString << " not found." << endl;
-		return Command::NONE;
-	}
+static bool toIndex(string_view word, int& index)
+{
+	auto [end, error] = from_chars(word.data(), word.data() + word.length(), index);
+	return error == errc() && end == word.data() + word.length() && index >= 0;
 }
 
-string Parser::arg1()
+bool Parser::decode(string_view line, VMProgram& program, VMInstruction& instruction)
 {
-	auto firstSpace = currLine.find_first_of(" ");
-	auto lastSpace = currLine.find_last_of(" ");
-	if (firstSpace != string::npos) {
-		return currLine.substr(firstSpace + 1, lastSpace - firstSpace - 1);
+	if (line.starts_with("//")) {
+		instruction.command = Command::COMMENT;
+		instruction.name = static_cast<int>(program.comments.size());
+		program.comments.emplace_back(line);
+		return true;
 	}
-	else return currLine;
-}
 
-bool is_number(const std::string& s) {
-	// Note: does not work for UTF-8 strings
-	return !s.empty() && std::all_of(s.begin(), s.end(), ::isdigit);
+	string_view word = nextWord(line);
+	auto commandIt = find_if(begin(commandNames), end(commandNames), [&](const CommandName& command) { return command.name == word; });
+	if (commandIt == end(commandNames)) {
+		return false;
+	}
+	instruction.command = commandIt->command;
+	instruction.arith = commandIt->arith;
+
+	switch (instruction.command) {
+		case Command::C_PUSH:
+		case Command::C_POP: {
+			word = nextWord(line);
+			auto segmentIt = find(begin(segmentNames), end(segmentNames), word);
+			if (segmentIt == end(segmentNames)) return false;
+			instruction.segment = static_cast<Segment>(segmentIt - begin(segmentNames));
+			return toIndex(nextWord(line), instruction.index);
+		}
+		case Command::C_LABEL:
+		case Command::C_GOTO:
+		case Command::C_IF:
+			word = nextWord(line);
+			if (word.empty()) return false;
+			instruction.name = program.names.intern(word);
+			return true;
+		case Command::C_FUNCTION:
+		case Command::C_CALL:
+			word = nextWord(line);
+			if (word.empty()) return false;
+			instruction.name = program.names.intern(word);
+			return toIndex(nextWord(line), instruction.index);
+		default:
+			return true;
+	}
 }
 
-const int Parser::arg2()
+void Parser::parse(VMProgram& program)
 {
-	if (currCommandType == Command::C_PUSH || currCommandType == Command::C_POP || currCommandType == Command::C_FUNCTION || currCommandType == Command::C_CALL) {
-		string arg2String = currLine.substr(currLine.find_last_of(" ") + 1);
-		if (is_number(arg2String)) // it's either this or use a try/catch block
-			return stoi(arg2String);	
+	const int file = static_cast<int>(program.files.size());
+	program.files.push_back(filesystem::path(filename).filename().string());
+
+	const size_t firstFunction = program.functions.size();
+	program.functions.emplace_back(); // collects commands outside of any function
+	program.functions.back().file = file;
+	program.functions.back().begin = program.code.size();
+
+	auto finishFunction = [&]() {
+		VMFunction& function = program.functions.back();
+		function.end = program.code.size();
+		sort(function.calls.begin(), function.calls.end());
+		function.calls.erase(unique(function.calls.begin(), function.calls.end()), function.calls.end());
+	};
+
+	const string_view text = source;
+	size_t pos = 0;
+	while (pos < text.length()) {
+		size_t lineEnd = min(text.find('\n', pos), text.length());
+		string_view line = removeWhitespace(text.substr(pos, lineEnd - pos));
+		pos = lineEnd + 1;
+		++lineNum;
+		if (line.empty()) continue;
+
+		VMInstruction instruction;
+		if (!decode(line, program, instruction)) {
+			cout << "Skipping unrecognized command at line " << lineNum << " of " << filename << ": " << line << endl;
+			continue;
+		}
+		if (instruction.command == Command::C_FUNCTION) {
+			finishFunction();
+			program.functions.emplace_back();
+			program.functions.back().name = instruction.name;
+			program.functions.back().numVars = instruction.index;
+			program.functions.back().file = file;
+			program.functions.back().begin = program.code.size();
+			continue;
+		}
+		if (instruction.command == Command::C_CALL) {
+			program.functions.back().calls.push_back(instruction.name);
+		}
+		program.code.push_back(instruction);
 	}
-	return NAN;
-}
+	finishFunction();
 
-string& Parser::getCurrLine() {
-	return currLine;
+	if (program.functions[firstFunction].begin == program.functions[firstFunction].end) {
+		program.functions.erase(program.functions.begin() + firstFunction);
+	}
 }
 
 void Parser::close() {
-	if (vmFile.is_open()) {
-		vmFile.close();
+	if (!failedOpen) {
+		source.clear();
 		cout << "===============" << endl;
 	}
 }
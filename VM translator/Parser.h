@@ -1,32 +1,49 @@
 #pragma once
 
 #include <string>
-#include <fstream>
-#include <set>
-#include <map>
+#include <string_view>
+#include <vector>
 #include "Shared.h"
+#include "NameTable.h"
+
+// A function body within VMProgram::code. Commands that appear before the first
+// "function" command of a file are kept in a function without a name.
+struct VMFunction {
+	int name = -1;
+	int numVars = 0;
+	int file = 0;            // index into VMProgram::files, used for static variables
+	size_t begin = 0;        // first command of the body, after the function command
+	size_t end = 0;
+	std::vector<int> calls;  // names of the functions called from the body
+};
+
+struct VMProgram {
+	NameTable names;
+	std::vector<std::string> files;
+	std::vector<std::string> comments;
+	std::vector<VMInstruction> code;
+	std::vector<VMFunction> functions;
+};
 
 class Parser
 {
 public:
 	Parser(const std::string& filename);
+	Parser(const std::string& filename, std::string source); // VM code already in memory, e.g. from the compiler
 	bool didFailOpen();
-	bool hasMoreCommands(); 
-	void advance();
-	Command commandType();
-	Command currCommandType = Command::NONE;
-	std::string arg1(); 
-	const int arg2();
-	std::string& getCurrLine();
+	void parse(VMProgram& program); // decodes the whole file and appends it to the program
 	void close();
+	// The name a function command declares, read the way parse() reads it; empty for any other line
+	static std::string_view functionName(std::string_view line);
 
 	~Parser();
 
 private:
 	bool failedOpen = false;
-	void removeWhitespace(std::string& line);
-	std::ifstream vmFile;
-	std::string currLine;
-	std::set<std::string> calledFunctions;
+	std::string filename;
+	std::string source;
+	int lineNum = 0;
+	bool decode(std::string_view line, VMProgram& program, VMInstruction& instruction);
+	static std::string_view removeWhitespace(std::string_view line);
+	static std::string_view nextWord(std::string_view& line);
 };
-
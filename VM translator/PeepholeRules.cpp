@@ -0,0 +1,170 @@
+#include "PeepholeRules.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <map>
+#include <set>
+
+using namespace std;
+
+static const set<string_view> predefinedNames = {
+	"SP", "LCL", "ARG", "THIS", "THAT", "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7",
+	"R8", "R9", "R10", "R11", "R12", "R13", "R14", "R15", "SCREEN", "KBD"
+};
+
+// An A-instruction that loads a label or variable, which a $k of a pattern stands for
+static bool loadsSymbol(string_view line)
+{
+	if (line.size() < 2 || line[0] != '@') return false;
+	string_view operand = line.substr(1);
+	return !predefinedNames.count(operand) && !all_of(operand.begin(), operand.end(), ::isdigit);
+}
+
+static vector<string> splitInstructions(string_view text)
+{
+	vector<string> lines;
+	size_t start = text.find_first_not_of(' ');
+	while (start != string_view::npos) {
+		size_t end = text.find(' ', start);
+		lines.emplace_back(text.substr(start, end == string_view::npos ? string_view::npos : end - start));
+		start = text.find_first_not_of(' ', end);
+	}
+	return lines;
+}
+
+PeepholeRules::PeepholeRules(const string& filename)
+{
+	ifstream file(filename);
+	if (!file.is_open()) {
+		cout << "Error opening rules file " << filename << endl;
+		failedOpen = true;
+		return;
+	}
+	string line;
+	while (getline(file, line)) {
+		if (line.empty() || line[0] == '#') continue;
+		size_t first = line.find('|');
+		size_t second = (first == string::npos ? string::npos : line.find('|', first + 1));
+		if (second == string::npos) {
+			cout << "Skipping malformed rule \"" << line << "\" in " << filename << endl;
+			continue;
+		}
+		Rule rule;
+		rule.pattern = splitInstructions(string_view(line).substr(first + 1, second - first - 1));
+		rule.replacement = splitInstructions(string_view(line).substr(second + 1));
+		if (rule.pattern.empty() || rule.replacement.size() >= rule.pattern.size()) continue;
+		const string& last = rule.pattern.back();
+		byLast[last.rfind("@$", 0) == 0 ? "@$" : last].push_back(static_cast<int>(rules.size()));
+		rules.push_back(std::move(rule));
+	}
+}
+
+bool PeepholeRules::didFailOpen() const
+{
+	return failedOpen;
+}
+
+int PeepholeRules::size() const
+{
+	return static_cast<int>(rules.size());
+}
+
+// Whether the pattern matches the last instructions of the run, each $k standing for one symbol
+bool PeepholeRules::matches(const Rule& rule, const vector<string>& lines, const vector<size_t>& run) const
+{
+	if (rule.pattern.size() > run.size()) return false;
+	const size_t first = run.size() - rule.pattern.size();
+	map<string_view, string_view> bound;
+	for (size_t i = 0; i < rule.pattern.size(); ++i) {
+		const string& expected = rule.pattern[i];
+		const string& line = lines[run[first + i]];
+		if (expected.rfind("@$", 0) == 0) {
+			if (!loadsSymbol(line)) return false;
+			auto [it, isNew] = bound.try_emplace(expected, line);
+			if (!isNew && it->second != line) return false;
+		}
+		else if (expected != line) {
+			return false;
+		}
+	}
+	return true;
+}
+
+string PeepholeRules::apply(string_view assembly, int& numRewrites) const
+{
+	numRewrites = 0;
+	vector<string> lines;     // output so far
+	vector<size_t> run;       // indices of the instructions since the last label or jump
+	vector<string> pending;   // replacement instructions still to go through the rules, last first
+	size_t lineStart = 0;
+	while (lineStart < assembly.size() || !pending.empty()) {
+		string line;
+		if (!pending.empty()) {
+			line = std::move(pending.back());
+			pending.pop_back();
+		}
+		else {
+			size_t lineEnd = assembly.find('\n', lineStart);
+			if (lineEnd == string_view::npos) lineEnd = assembly.size();
+			line = string(assembly.substr(lineStart, lineEnd - lineStart));
+			lineStart = lineEnd + 1;
+		}
+
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == string::npos || line.compare(first, 2, "//") == 0) {
+			lines.push_back(std::move(line)); // comments and blank lines are kept where they are
+			continue;
+		}
+		string instruction = line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+		size_t comment = instruction.find("//");
+		if (comment != string::npos) instruction = instruction.substr(0, instruction.find_last_not_of(" \t", comment - 1) + 1);
+		lines.push_back(std::move(line));
+		if (instruction[0] == '(' || instruction.find(';') != string::npos) {
+			run.clear();
+			continue;
+		}
+		lines.back() = instruction;
+		run.push_back(lines.size() - 1);
+
+		// The best ranked rule among those ending with this instruction
+		int best = -1;
+		for (auto& key : { loadsSymbol(instruction) ? string("@$") : string(), instruction }) {
+			auto it = byLast.find(key);
+			if (it == byLast.end()) continue;
+			for (int r : it->second) {
+				if (best >= 0 && r > best) break;
+				if (matches(rules[r], lines, run)) {
+					best = r;
+					break;
+				}
+			}
+		}
+		if (best < 0) continue;
+
+		const Rule& rule = rules[best];
+		const size_t start = run[run.size() - rule.pattern.size()];
+		map<string, string> bound;
+		for (size_t i = 0; i < rule.pattern.size(); ++i) {
+			if (rule.pattern[i].rfind("@$", 0) == 0) bound[rule.pattern[i]] = lines[run[run.size() - rule.pattern.size() + i]];
+		}
+		vector<string> comments;
+		for (size_t i = start; i < lines.size(); ++i) {
+			if (std::find(run.begin(), run.end(), i) == run.end()) comments.push_back(std::move(lines[i]));
+		}
+		lines.resize(start);
+		lines.insert(lines.end(), std::make_move_iterator(comments.begin()), std::make_move_iterator(comments.end()));
+		run.resize(run.size() - rule.pattern.size());
+		for (auto it = rule.replacement.rbegin(); it != rule.replacement.rend(); ++it) {
+			auto symbol = bound.find(*it);
+			pending.push_back(symbol != bound.end() ? symbol->second : *it);
+		}
+		++numRewrites;
+	}
+
+	string result;
+	for (auto& line : lines) {
+		result += line;
+		result += '\n';
+	}
+	return result;
+}
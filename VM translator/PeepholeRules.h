@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+// Rewrite rules for straight-line Hack assembly, as found by the superoptimizer (see
+// Superoptimizer/). The rules file has one rule per line, most frequent first:
+//   <count> | <pattern> | <replacement>
+// with the instructions of each separated by spaces and $0, $1... standing for any symbol
+// (not a number or predefined name). Lines starting with # are comments.
+class PeepholeRules
+{
+public:
+	PeepholeRules(const std::string& filename);
+	bool didFailOpen() const;
+	int size() const;
+
+	// Rewrites every match in the assembly and returns the result. Comments inside a match
+	// are moved before its replacement; labels and jumps end the code a match may span.
+	// A replacement can complete the match of another rule, so rewrites cascade.
+	std::string apply(std::string_view assembly, int& numRewrites) const;
+
+private:
+	struct Rule {
+		std::vector<std::string> pattern;
+		std::vector<std::string> replacement;
+	};
+
+	std::vector<Rule> rules;                                   // by rank, the first that matches wins
+	std::unordered_map<std::string, std::vector<int>> byLast; // rules by the last line of their pattern, "@$" for any symbol
+	bool failedOpen = false;
+
+	bool matches(const Rule& rule, const std::vector<std::string>& lines, const std::vector<size_t>& run) const;
+};
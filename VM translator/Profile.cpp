@@ -0,0 +1,71 @@
+#include "Profile.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+Profile::Profile(const string& filename)
+{
+	ifstream profileFile(filename);
+	if (!profileFile.is_open()) {
+		cout << "Error opening profile " << filename << endl;
+		failedOpen = true;
+		return;
+	}
+	string line;
+	while (getline(profileFile, line)) {
+		istringstream fields(line);
+		long long count;
+		string label;
+		if (!(fields >> count >> label)) continue; // blank lines and comments
+		counts[label] += count;
+		maxCount = max(maxCount, counts[label]);
+	}
+}
+
+bool Profile::didFailOpen()
+{
+	return failedOpen;
+}
+
+bool Profile::contains(const string& label) const
+{
+	return counts.count(label) > 0;
+}
+
+long long Profile::hits(const string& label) const
+{
+	auto it = counts.find(label);
+	return it == counts.end() ? 0 : it->second;
+}
+
+long long Profile::hotThreshold() const
+{
+	// Anything within a factor of 1000 of the hottest label, so one-off setup code stays cold
+	return max(1LL, maxCount / 1000);
+}
+
+vector<long long> Profile::instructionCounts(const VMProgram& program, const vector<int>& selected) const
+{
+	vector<long long> result(program.code.size(), 0);
+	for (int f : selected) {
+		const VMFunction& function = program.functions[f];
+		if (function.name < 0) { // bootstrap code outside functions runs once
+			fill(result.begin() + function.begin, result.begin() + function.end, 1);
+			continue;
+		}
+		const string& functionName = program.names[function.name];
+		long long count = hits(functionName);
+		for (size_t i = function.begin; i < function.end; ++i) {
+			const VMInstruction& instruction = program.code[i];
+			if (instruction.command == Command::C_LABEL) {
+				auto it = counts.find(functionName + "$" + program.names[instruction.name]);
+				if (it != counts.end()) count = it->second;
+			}
+			result[i] = count;
+		}
+	}
+	return result;
+}
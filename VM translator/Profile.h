@@ -0,0 +1,29 @@
+#pragma once
+#include "Parser.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Execution counts from an emulator run of a previous translation. Each line of the file is
+// "<count> <label>", where the label is an assembly label as the translator writes it: a
+// function name for the number of calls, or function$label for a VM label. Labels that never
+// ran should be listed with a count of 0, so they can be told apart from code that is new.
+class Profile
+{
+public:
+	Profile(const std::string& filename);
+	bool didFailOpen();
+
+	bool contains(const std::string& label) const;
+	long long hits(const std::string& label) const; // 0 if the label is not in the profile
+	long long hotThreshold() const; // code that ran at least this often is compiled for speed
+
+	// Estimated count for every instruction: the count of the nearest label or function entry
+	// above it. Labels missing from the profile (copies made by the Inliner) keep the estimate.
+	std::vector<long long> instructionCounts(const VMProgram& program, const std::vector<int>& selected) const;
+
+private:
+	bool failedOpen = false;
+	std::unordered_map<std::string, long long> counts;
+	long long maxCount = 0;
+};
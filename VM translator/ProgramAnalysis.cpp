@@ -0,0 +1,187 @@
+#include "ProgramAnalysis.h"
+#include <algorithm>
+
+using namespace std;
+
+bool isStackBalanced(const VMProgram& program, const VMFunction& function, bool* returns, string* problem)
+{
+	unordered_map<int, int> labelDepth;
+	int depth = 0;
+	bool reachable = true;
+	bool anyReturn = false;
+	auto fail = [&](const string& why) {
+		if (problem) *problem = why;
+		return false;
+	};
+	auto join = [&](int label) {
+		auto [it, inserted] = labelDepth.emplace(label, depth);
+		return inserted || it->second == depth;
+	};
+	auto mismatch = [&](int label) {
+		return fail("label " + program.names[label] + " is reached with " + to_string(labelDepth[label]) + " and with "
+			+ to_string(depth) + " values on the stack");
+	};
+	auto isJumpedToLater = [&](size_t from, int label) {
+		return std::any_of(program.code.begin() + from, program.code.begin() + function.end, [&](const VMInstruction& instruction) {
+			return (instruction.command == Command::C_GOTO || instruction.command == Command::C_IF) && instruction.name == label;
+		});
+	};
+
+	for (size_t i = function.begin; i < function.end; ++i) {
+		const VMInstruction& instruction = program.code[i];
+		switch (instruction.command) {
+			case Command::C_PUSH:
+				++depth;
+				break;
+			case Command::C_POP:
+				--depth;
+				break;
+			case Command::C_ARITHMETIC:
+				if (instruction.arith != Arith::NEG && instruction.arith != Arith::NOT) --depth;
+				break;
+			case Command::C_CALL:
+				depth += 1 - instruction.index;
+				break;
+			case Command::C_LABEL:
+				if (reachable) {
+					if (!join(instruction.name)) return mismatch(instruction.name);
+				}
+				else {
+					auto it = labelDepth.find(instruction.name);
+					if (it != labelDepth.end()) {
+						depth = it->second;
+						reachable = true;
+					}
+					else if (isJumpedToLater(i, instruction.name)) {
+						return fail("label " + program.names[instruction.name] + " is only reached by a later backward jump, its stack depth is unknown");
+					}
+					// otherwise nothing jumps here and the code stays dead
+				}
+				break;
+			case Command::C_GOTO:
+				if (reachable && !join(instruction.name)) return mismatch(instruction.name);
+				reachable = false;
+				break;
+			case Command::C_IF:
+				--depth;
+				if (reachable && !join(instruction.name)) return mismatch(instruction.name);
+				break;
+			case Command::C_RETURN:
+				if (reachable && depth != 1) return fail("return with " + to_string(depth) + " values on the stack instead of 1");
+				anyReturn |= reachable;
+				reachable = false;
+				break;
+			default:
+				break;
+		}
+		if (reachable && depth < 0) return fail("pops more values than the function has pushed");
+	}
+	if (returns) *returns = anyReturn;
+	if (reachable) return fail("runs off its end without returning");
+	return true;
+}
+
+unordered_map<int, int> callArgCounts(const VMProgram& program, const vector<int>& selected)
+{
+	unordered_map<int, int> numArgs;
+	for (int f : selected) {
+		const VMFunction& function = program.functions[f];
+		for (size_t i = function.begin; i < function.end; ++i) {
+			const VMInstruction& instruction = program.code[i];
+			if (instruction.command != Command::C_CALL) continue;
+			auto [it, inserted] = numArgs.emplace(instruction.name, instruction.index);
+			if (!inserted && it->second != instruction.index) it->second = -1;
+		}
+	}
+	return numArgs;
+}
+
+CallGraph::CallGraph(const VMProgram& program, const vector<int>& selected, const ExternalCalls* external):
+	edges(program.functions.size()), recursive(program.functions.size(), false)
+{
+	vector<int> functionIndex(program.names.size(), -1);
+	for (int f : selected) {
+		if (program.functions[f].name >= 0) functionIndex[program.functions[f].name] = f;
+	}
+	for (int f : selected) {
+		for (int callee : program.functions[f].calls) {
+			if (functionIndex[callee] >= 0) edges[f].push_back(functionIndex[callee]);
+		}
+	}
+	if (external) {
+		for (auto [caller, callee] : external->paths) {
+			if (std::find(edges[caller].begin(), edges[caller].end(), callee) == edges[caller].end()) edges[caller].push_back(callee);
+		}
+	}
+
+	// Tarjan's algorithm, iterative so deep call chains cannot overflow the stack.
+	// Components come out callees first and are reversed at the end.
+	const int n = static_cast<int>(edges.size());
+	vector<int> index(n, -1), lowLink(n, 0);
+	vector<bool> onStack(n, false);
+	vector<int> stack;
+	vector<pair<int, size_t>> work;
+	int counter = 0;
+	for (int root : selected) {
+		if (index[root] >= 0) continue;
+		work.emplace_back(root, 0);
+		while (!work.empty()) {
+			auto& [v, next] = work.back();
+			if (next == 0) {
+				index[v] = lowLink[v] = counter++;
+				stack.push_back(v);
+				onStack[v] = true;
+			}
+			if (next < edges[v].size()) {
+				int w = edges[v][next++];
+				if (index[w] < 0) {
+					work.emplace_back(w, 0);
+				}
+				else if (onStack[w]) {
+					lowLink[v] = min(lowLink[v], index[w]);
+				}
+				continue;
+			}
+			if (lowLink[v] == index[v]) {
+				vector<int> component;
+				int w;
+				do {
+					w = stack.back();
+					stack.pop_back();
+					onStack[w] = false;
+					component.push_back(w);
+				} while (w != v);
+				sccs.push_back(std::move(component));
+			}
+			int finished = v;
+			work.pop_back();
+			if (!work.empty()) {
+				int parent = work.back().first;
+				lowLink[parent] = min(lowLink[parent], lowLink[finished]);
+			}
+		}
+	}
+	reverse(sccs.begin(), sccs.end());
+
+	for (auto& component : sccs) {
+		bool selfCall = find(edges[component[0]].begin(), edges[component[0]].end(), component[0]) != edges[component[0]].end();
+		if (component.size() > 1 || selfCall) {
+			for (int f : component) recursive[f] = true;
+		}
+	}
+}
+
+bool CallGraph::isRecursive(int function) const
+{
+	return recursive[function];
+}
+
+const vector<vector<int>>& CallGraph::components() const
+{
+	return sccs;
+}
+
+const vector<int>& CallGraph::callees(int function) const
+{
+	return edges[function];
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "Parser.h"
+#include <vector>
+#include <unordered_map>
+#include <string>
+
+// Whole-program facts about decoded VM code, shared by the translation passes
+
+// Every label is reached with a single stack depth and every reachable return leaves exactly
+// the return value on the function's own stack. returns is set when some return is reachable.
+// When the function is not balanced, problem says why and where.
+bool isStackBalanced(const VMProgram& program, const VMFunction& function, bool* returns = nullptr, std::string* problem = nullptr);
+
+// Number of arguments passed to each called function (by name), -1 where call sites disagree
+std::unordered_map<int, int> callArgCounts(const VMProgram& program, const std::vector<int>& selected);
+
+// Calls that reach the program through code outside of it (a linked library), by index into
+// VMProgram::functions
+struct ExternalCalls {
+	std::vector<int> entered;                   // functions called from outside
+	std::vector<std::pair<int, int>> paths;     // the caller can get to the callee through outside code
+};
+
+// Call graph of the selected functions, by index into VMProgram::functions
+class CallGraph
+{
+public:
+	CallGraph(const VMProgram& program, const std::vector<int>& selected, const ExternalCalls* external = nullptr);
+
+	bool isRecursive(int function) const; // can be re-entered while it is running
+	// Strongly connected components, callers before callees
+	const std::vector<std::vector<int>>& components() const;
+	const std::vector<int>& callees(int function) const;
+
+private:
+	std::vector<std::vector<int>> edges;
+	std::vector<std::vector<int>> sccs;
+	std::vector<bool> recursive;
+};
@@ -0,0 +1,18 @@
+// Tests NotIfGoto.asm on the CPU emulator.
+// Before executing the code, initializes the stack pointer
+// and the base address of the local segment.
+
+load NotIfGoto.asm,
+output-file NotIfGoto.out,
+compare-to NotIfGoto.cmp,
+
+set RAM[0] 256,  // SP
+set RAM[1] 300,  // LCL
+
+repeat 300 {
+	ticktock;
+}
+
+// Outputs the stack pointer and the four results
+output-list RAM[0]%D1.6.1 RAM[300]%D1.6.1 RAM[301]%D1.6.1 RAM[302]%D1.6.1 RAM[303]%D1.6.1;
+output;
@@ -0,0 +1,18 @@
+// Tests and illustrates NotIfGoto.vm on the VM emulator.
+// Before executing the code, initializes the stack pointer
+// and the base address of the local segment.
+
+load NotIfGoto.vm,
+output-file NotIfGoto.out,
+compare-to NotIfGoto.cmp,
+
+set sp 256,
+set local 300,
+
+repeat 40 {
+ 	vmstep;
+}
+
+// Outputs the stack pointer and the four results
+output-list RAM[0]%D1.6.1 RAM[300]%D1.6.1 RAM[301]%D1.6.1 RAM[302]%D1.6.1 RAM[303]%D1.6.1;
+output;
@@ -1,6 +1,20 @@
 #ifndef SHARED_H
 #define SHARED_H
-#define NAN 1234567
-enum class Command { NONE, COMMENT, C_ARITHMETIC, C_PUSH, C_POP, C_LABEL, C_GOTO, C_IF, C_FUNCTION, C_RETURN, C_CALL };
+#include <cstdint>
+
+enum class Command : uint8_t { NONE, COMMENT, C_ARITHMETIC, C_PUSH, C_POP, C_LABEL, C_GOTO, C_IF, C_FUNCTION, C_RETURN, C_CALL };
+// NAMED is not part of the VM language: it addresses the assembler variable <name>.<index>,
+// and is produced when the translator rewrites code (e.g. inlined arguments and locals).
+enum class Segment : uint8_t { CONST = 0, ARG, LOCAL, STATIC, THIS, THAT, POINTER, TEMP, NAMED, NONE };
+enum class Arith : uint8_t { ADD = 0, SUB, NEG, EQ, GT, LT, AND, OR, NOT, NONE };
+
+// A VM command decoded once by the Parser. Whole files are stored as one contiguous vector of these.
+struct VMInstruction {
+	Command command = Command::NONE;
+	Arith arith = Arith::NONE;       // C_ARITHMETIC
+	Segment segment = Segment::NONE; // C_PUSH, C_POP
+	int index = 0;                   // segment index, number of locals of a function or number of arguments of a call
+	int name = -1;                   // interned label or function name, comment id, or variable name for Segment::NAMED
+};
 
 #endif // !SHARED_H
@@ -0,0 +1,533 @@
+#include "Translation.h"
+#include "Inliner.h"
+#include "Profile.h"
+#include "Outliner.h"
+#include "PeepholeRules.h"
+#include "CostReport.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <memory>
+
+using namespace std;
+
+const vector<string> osFiles = { "Array.vm", "Keyboard.vm", "Math.vm", "Memory.vm", "Output.vm", "Screen.vm", "String.vm", "Sys.vm" };
+
+const set<string> entryPoints = { "Sys.init", "String.intValue" };
+
+TranslationOptions::TranslationOptions(): jobs(std::max(1u, thread::hardware_concurrency()))
+{
+}
+
+bool TranslationOptions::parse(int& i, int argc, char* argv[])
+{
+	string arg = argv[i];
+	if (arg == "-jobs" && i + 1 < argc) {
+		jobs = std::max(1, stoi(argv[++i]));
+	}
+	else if (arg == "-tos") {
+		cacheTop = true;
+	}
+	else if (arg == "-defer-sp") {
+		cacheTop = true; // the deferred SP is tracked alongside the cached top
+		deferSP = true;
+	}
+	else if (arg == "-call-stubs") {
+		callStubs = true;
+	}
+	else if (arg == "-static-frames") {
+		staticFrames = true;
+	}
+	else if (arg == "-inline" && i + 1 < argc) {
+		inlineSize = std::max(0, stoi(argv[++i]));
+	}
+	else if (arg == "-size-budget" && i + 1 < argc) {
+		sizeBudget = std::max(0, stoi(argv[++i]));
+	}
+	else if (arg == "-profile" && i + 1 < argc) {
+		profileName = argv[++i];
+	}
+	else if (arg == "-cache") {
+		useCache = true;
+	}
+	else if (arg == "-outline") {
+		outline = true;
+	}
+	else if (arg == "-rules" && i + 1 < argc) {
+		rulesName = argv[++i];
+	}
+	else if (arg == "-report" && i + 1 < argc) {
+		reportName = argv[++i];
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+// Walks the call graph once from the entry points. Each function's call list was
+// collected while parsing, so no file has to be read again. Library functions are followed
+// through the symbols their sections refer to.
+static vector<bool> findReachable(const VMProgram& program, const ObjectLibrary* library)
+{
+	const vector<VMFunction>& functions = program.functions;
+	vector<int> functionIndex(program.names.size(), -1); // function defined under each name
+	for (size_t i = 0; i < functions.size(); ++i) {
+		if (functions[i].name >= 0) functionIndex[functions[i].name] = static_cast<int>(i);
+	}
+
+	vector<bool> reachable(functions.size(), false);
+	vector<bool> reachableSection(library ? library->sections().size() : 0, false);
+	vector<int> worklist;
+	vector<int> sectionWorklist;
+	auto visitSection = [&](const string& symbol) {
+		int section = library ? library->sectionOf(symbol) : -1;
+		if (section < 0) return false;
+		if (!reachableSection[section]) {
+			reachableSection[section] = true;
+			sectionWorklist.push_back(section);
+		}
+		return true;
+	};
+	auto visit = [&](int name) {
+		if (name < 0 || functionIndex[name] < 0) return false;
+		int index = functionIndex[name];
+		if (!reachable[index]) {
+			reachable[index] = true;
+			worklist.push_back(index);
+		}
+		return true;
+	};
+
+	for (size_t i = 0; i < functions.size(); ++i) {
+		if (functions[i].name < 0) { // code outside of any function always runs
+			reachable[i] = true;
+			worklist.push_back(static_cast<int>(i));
+		}
+	}
+	for (auto& name : entryPoints) {
+		if (!visit(program.names.find(name))) visitSection(name);
+	}
+
+	while (!worklist.empty() || !sectionWorklist.empty()) {
+		if (!sectionWorklist.empty()) {
+			int section = sectionWorklist.back();
+			sectionWorklist.pop_back();
+			for (auto& relocation : library->sections()[section].relocations) {
+				if (!visit(program.names.find(relocation.second))) visitSection(relocation.second);
+			}
+			continue;
+		}
+		int current = worklist.back();
+		worklist.pop_back();
+		for (int callee : functions[current].calls) {
+			if (!visit(callee) && !visitSection(program.names[callee])) {
+				std::cout << "Warning: " << (functions[current].name < 0 ? program.files[functions[current].file] : program.names[functions[current].name])
+					<< " calls undefined function " << program.names[callee] << endl;
+			}
+		}
+	}
+	return reachable;
+}
+
+// Calls into the program that come back through the library: the functions library code calls,
+// and for each call into the library, which of the program's functions it can lead to.
+static ExternalCalls findExternalCalls(const VMProgram& program, const vector<int>& selected, const ObjectLibrary& library)
+{
+	vector<int> functionIndex(program.names.size(), -1);
+	for (int f : selected) {
+		if (program.functions[f].name >= 0) functionIndex[program.functions[f].name] = f;
+	}
+	auto programFunction = [&](const string& symbol) {
+		int name = program.names.find(symbol);
+		return name >= 0 ? functionIndex[name] : -1;
+	};
+
+	const vector<ObjectSection>& sections = library.sections();
+	ExternalCalls external;
+	vector<bool> entered(program.functions.size(), false);
+	for (auto& section : sections) {
+		for (auto& relocation : section.relocations) {
+			int f = programFunction(relocation.second);
+			if (f >= 0 && !entered[f]) {
+				entered[f] = true;
+				external.entered.push_back(f);
+			}
+		}
+	}
+	if (external.entered.empty()) return external;
+
+	// Program functions each library section leads to without leaving the library
+	vector<vector<int>> leadsTo(sections.size());
+	vector<bool> searched(sections.size(), false);
+	auto search = [&](int root) -> const vector<int>& {
+		if (searched[root]) return leadsTo[root];
+		searched[root] = true;
+		vector<bool> seen(sections.size(), false);
+		vector<int> stack = { root };
+		seen[root] = true;
+		while (!stack.empty()) {
+			int s = stack.back();
+			stack.pop_back();
+			for (auto& relocation : sections[s].relocations) {
+				int f = programFunction(relocation.second);
+				if (f >= 0) {
+					if (std::find(leadsTo[root].begin(), leadsTo[root].end(), f) == leadsTo[root].end()) leadsTo[root].push_back(f);
+					continue;
+				}
+				int next = library.sectionOf(relocation.second);
+				if (next >= 0 && !seen[next]) {
+					seen[next] = true;
+					stack.push_back(next);
+				}
+			}
+		}
+		return leadsTo[root];
+	};
+	for (int f : selected) {
+		for (int callee : program.functions[f].calls) {
+			if (functionIndex[callee] >= 0) continue;
+			int section = library.sectionOf(program.names[callee]);
+			if (section < 0) continue;
+			for (int target : search(section)) external.paths.emplace_back(f, target);
+		}
+	}
+	return external;
+}
+
+// Comparisons that can go through the shared routines, coldest first. Without a profile,
+// a site is considered hotter the more loops (backward jumps) surround it.
+static vector<int> compareSitesByHeat(const VMProgram& program, const vector<int>& selected, const vector<long long>* counts)
+{
+	vector<pair<long long, int>> sites; // execution count or loop depth, instruction index
+	for (int f : selected) {
+		const VMFunction& function = program.functions[f];
+		vector<int> depth(function.end - function.begin, 0);
+		unordered_map<int, size_t> labels;
+		for (size_t i = function.begin; i < function.end; ++i) {
+			const VMInstruction& instruction = program.code[i];
+			if (instruction.command == Command::C_LABEL) {
+				labels.emplace(instruction.name, i);
+			}
+			else if (instruction.command == Command::C_GOTO || instruction.command == Command::C_IF) {
+				auto it = labels.find(instruction.name);
+				if (it == labels.end()) continue; // forward jump
+				for (size_t j = it->second; j <= i; ++j) ++depth[j - function.begin];
+			}
+		}
+		for (size_t i = function.begin; i < function.end; ++i) {
+			Arith arith = program.code[i].arith;
+			if ((arith == Arith::EQ || arith == Arith::GT || arith == Arith::LT) && !CodeWriter::foldsIntoBranch(program.code, i, function.end)) {
+				sites.emplace_back(counts ? (*counts)[i] : depth[i - function.begin], static_cast<int>(i));
+			}
+		}
+	}
+	std::stable_sort(sites.begin(), sites.end(), [](auto& a, auto& b) { return a.first < b.first; });
+	vector<int> order;
+	for (auto& site : sites) order.push_back(site.second);
+	return order;
+}
+
+bool translateProgram(VMProgram& program, bool isDirectory, const TranslationOptions& options, CodeWriter& codeWriter,
+	const ObjectLibrary* library)
+{
+	codeWriter.setTopOfStackCaching(options.cacheTop);
+	codeWriter.setDeferredStackPointer(options.deferSP);
+
+	unique_ptr<Profile> profile;
+	if (!options.profileName.empty()) {
+		profile = make_unique<Profile>(options.profileName);
+		if (profile->didFailOpen()) {
+			return false;
+		}
+		int numProfiled = std::count_if(program.functions.begin(), program.functions.end(),
+			[&](auto& function) { return function.name >= 0 && profile->contains(program.names[function.name]); });
+		std::cout << "Loaded profile for " << numProfiled << " functions, code that ran at least " << profile->hotThreshold() << " times is hot." << endl;
+	}
+
+	unique_ptr<PeepholeRules> rules;
+	if (!options.rulesName.empty()) {
+		rules = make_unique<PeepholeRules>(options.rulesName);
+		if (rules->didFailOpen()) {
+			return false;
+		}
+	}
+
+	if (options.inlineSize > 0) {
+		// Runs before dead code analysis, so functions that are no longer called are dropped.
+		// With a profile, only hot call sites are worth the extra code.
+		vector<long long> counts;
+		if (profile) {
+			vector<int> all(program.functions.size());
+			for (size_t i = 0; i < all.size(); ++i) all[i] = static_cast<int>(i);
+			counts = profile->instructionCounts(program, all);
+		}
+		int sites = Inliner(program).run(options.inlineSize, profile ? &counts : nullptr, profile ? profile->hotThreshold() : 0);
+		std::cout << "Inlined " << sites << (profile ? " hot" : "") << " calls to functions of up to " << options.inlineSize << " commands." << endl;
+	}
+
+	const vector<VMFunction>& functions = program.functions;
+	int numFunctions = std::count_if(functions.begin(), functions.end(), [](auto& function) { return function.name >= 0; });
+	vector<bool> reachable(functions.size(), true);
+	if (isDirectory) {
+		// Single files are translated whole, since they have no Sys.init to start from
+		reachable = findReachable(program, library);
+	}
+	int numReachable = 0;
+	for (size_t i = 0; i < functions.size(); ++i) {
+		if (reachable[i] && functions[i].name >= 0) ++numReachable;
+	}
+	std::cout << "Completed dead code analysis. Out of " << numFunctions << " functions, only " << numReachable << " are called." << endl;
+
+	vector<int> selected;
+	for (size_t i = 0; i < functions.size(); ++i) {
+		if (reachable[i]) selected.push_back(static_cast<int>(i));
+	}
+
+	// Malformed functions are still translated as written, but deferred stack pointer updates,
+	// static frames and inlining all lean on balanced stacks, so they are reported
+	for (int f : selected) {
+		string problem;
+		if (functions[f].name >= 0 && !isStackBalanced(program, functions[f], nullptr, &problem)) {
+			std::cout << "Warning: " << program.names[functions[f].name] << " " << problem << "." << endl;
+		}
+	}
+
+	// Like the shared comparisons, the stubs are written with the bootstrap
+	FrameLayout frames;
+	if (isDirectory && (options.callStubs || options.staticFrames)) {
+		ExternalCalls external;
+		if (library) external = findExternalCalls(program, selected, *library);
+		frames = CodeWriter::planFrames(program, selected, options.callStubs, options.staticFrames, &external);
+		codeWriter.setFrameLayout(&frames);
+		if (options.callStubs) {
+			std::cout << "Using " << frames.shapes.size() << " call stubs for " << frames.shapeOf.size() << " functions." << endl;
+		}
+		if (options.staticFrames) {
+			std::cout << "Using static frames for " << frames.staticFrames.size() << " functions in " << frames.staticRegionSize << " words of RAM." << endl;
+		}
+	}
+
+	// Route the coldest comparisons through the shared routines until the program fits, as long
+	// as that makes it smaller. Comparisons the profile shows as cold cost no time, so they are
+	// shared whenever together they make the program smaller. The routines live in the
+	// bootstrap, so single files always compare inline.
+	vector<bool> sharedCompares(program.code.size(), false);
+	if (isDirectory && (options.sizeBudget >= 0 || profile)) {
+		codeWriter.setSharedCompares(&sharedCompares);
+		vector<long long> counts;
+		if (profile) counts = profile->instructionCounts(program, selected);
+		vector<int> sites = compareSitesByHeat(program, selected, profile ? &counts : nullptr);
+		size_t numShared = 0;
+		int size = codeWriter.countInstructions(program, selected, options.jobs);
+		int savedPerSite = 8;
+		// Shares the next batch of sites, or takes the batch back and returns false when it
+		// does not make the program smaller
+		auto shareBatch = [&](size_t batch) {
+			for (size_t k = 0; k < batch; ++k) sharedCompares[sites[numShared + k]] = true;
+			int newSize = codeWriter.countInstructions(program, selected, options.jobs);
+			if (newSize >= size) {
+				for (size_t k = 0; k < batch; ++k) sharedCompares[sites[numShared + k]] = false;
+				return false;
+			}
+			numShared += batch;
+			savedPerSite = std::max(1, (size - newSize) / static_cast<int>(batch));
+			size = newSize;
+			return true;
+		};
+		if (codeWriter.sharedComparesAreSmaller()) {
+			size_t numCold = 0;
+			while (profile && numCold < sites.size() && counts[sites[numCold]] < profile->hotThreshold()) ++numCold;
+			if (numCold > 0) shareBatch(numCold);
+			while (options.sizeBudget >= 0 && size > options.sizeBudget && numShared < sites.size()) {
+				size_t batch = std::min(sites.size() - numShared, static_cast<size_t>(std::max(1, (size - options.sizeBudget) / savedPerSite)));
+				if (!shareBatch(batch)) break;
+			}
+		}
+		std::cout << "Shared " << numShared << " of " << sites.size() << " comparisons, program is " << size << " instructions." << endl;
+		if (options.sizeBudget >= 0 && size > options.sizeBudget) {
+			std::cout << "Warning: program does not fit in the size budget of " << options.sizeBudget << " instructions." << endl;
+		}
+	}
+
+	if (isDirectory) {
+		codeWriter.writeInit();
+	}
+	codeWriter.translate(program, selected, options.jobs);
+	codeWriter.setFrameLayout(nullptr); // both point at locals of this function
+	codeWriter.setSharedCompares(nullptr);
+	if (rules) {
+		int before = codeWriter.output().instructionCount();
+		int numRewrites = codeWriter.applyPeephole(*rules);
+		std::cout << "Applied " << rules->size() << " peephole rules at " << numRewrites << " places, saving "
+			<< before - codeWriter.output().instructionCount() << " instructions." << endl;
+	}
+	if (!options.reportName.empty()) {
+		if (!CostReport(program, selected, codeWriter.output().view()).write(options.reportName)) {
+			return false;
+		}
+		std::cout << "Wrote the cost report to " << options.reportName << endl;
+	}
+	return true;
+}
+
+bool translateStream(istream& in, ostream& out, const TranslationOptions& options)
+{
+	if (options.sizeBudget >= 0 || options.inlineSize > 0 || options.callStubs || options.staticFrames || !options.profileName.empty()
+		|| options.outline || !options.reportName.empty()) {
+		std::cout << "Only -tos, -defer-sp and -rules apply to a stream, the other settings need the whole program." << endl;
+	}
+	unique_ptr<PeepholeRules> rules;
+	if (!options.rulesName.empty()) {
+		rules = make_unique<PeepholeRules>(options.rulesName);
+		if (rules->didFailOpen()) {
+			return false;
+		}
+	}
+
+	CodeWriter codeWriter;
+	codeWriter.setTopOfStackCaching(options.cacheTop);
+	codeWriter.setDeferredStackPointer(options.deferSP);
+	codeWriter.writeInit();
+	codeWriter.flush(out);
+
+	// Each piece is one function with the comments after it, translated as its own program
+	string piece;
+	string className = "Stream"; // for statics outside of any function
+	int numFunctions = 0;
+	int numRewrites = 0;
+	auto translatePiece = [&]() {
+		if (piece.empty()) return;
+		VMProgram program;
+		Parser parser(className + ".vm", std::move(piece));
+		parser.parse(program);
+		for (auto& function : program.functions) codeWriter.translate(program, function);
+		if (rules) numRewrites += codeWriter.applyPeephole(*rules);
+		codeWriter.flush(out);
+		piece.clear();
+	};
+	string line;
+	while (getline(in, line)) {
+		string_view function = Parser::functionName(line);
+		if (!function.empty()) {
+			translatePiece();
+			className = string(function.substr(0, function.find('.')));
+			++numFunctions;
+		}
+		piece += line;
+		piece += '\n';
+	}
+	translatePiece();
+	out.flush();
+	std::cout << "Translated " << numFunctions << " functions from the stream";
+	if (rules) std::cout << ", " << rules->size() << " peephole rules applied at " << numRewrites << " places";
+	std::cout << "." << endl;
+	return true;
+}
+
+bool buildLibrary(VMProgram& program, const TranslationOptions& options, ObjectLibrary& library)
+{
+	if (options.sizeBudget >= 0 || options.callStubs || options.staticFrames || !options.profileName.empty() || options.outline
+		|| !options.reportName.empty()) {
+		std::cout << "Only -tos, -defer-sp, -inline and -rules apply to a library, the other settings need the whole program." << endl;
+	}
+	if (options.inlineSize > 0) {
+		int sites = Inliner(program).run(options.inlineSize);
+		std::cout << "Inlined " << sites << " calls to functions of up to " << options.inlineSize << " commands." << endl;
+	}
+
+	unique_ptr<PeepholeRules> rules;
+	if (!options.rulesName.empty()) {
+		rules = make_unique<PeepholeRules>(options.rulesName);
+		if (rules->didFailOpen()) return false;
+	}
+	int numRewrites = 0;
+
+	for (size_t f = 0; f < program.functions.size(); ++f) {
+		const VMFunction& function = program.functions[f];
+		if (function.name < 0) {
+			bool hasCode = std::any_of(program.code.begin() + function.begin, program.code.begin() + function.end,
+				[](const VMInstruction& instruction) { return instruction.command != Command::COMMENT; });
+			if (hasCode) {
+				std::cout << "Warning: code outside of any function in " << program.files[function.file] << " is left out of the library." << endl;
+			}
+			continue;
+		}
+		// Labels are numbered per function, so a function translated on its own gets the same
+		// code as in a whole program
+		CodeWriter writer;
+		writer.setTopOfStackCaching(options.cacheTop);
+		writer.setDeferredStackPointer(options.deferSP);
+		writer.setDirectEncoding(!rules);
+		writer.translate(program, { static_cast<int>(f) }, 1);
+		if (rules) numRewrites += writer.applyPeephole(*rules);
+		ObjectSection section;
+		if (!rules) {
+			if (!writer.output().encodedValid()) return false;
+			section = writer.output().encoded();
+		}
+		section.name = program.names[function.name];
+		section.file = program.files[function.file];
+		if (rules && !section.assemble(writer.output().view())) {
+			return false;
+		}
+		library.add(std::move(section));
+	}
+	if (rules) {
+		std::cout << "Applied " << rules->size() << " peephole rules at " << numRewrites << " places." << endl;
+	}
+	return true;
+}
+
+bool encodesDirectly(const TranslationOptions& options)
+{
+	return options.rulesName.empty() && options.reportName.empty();
+}
+
+bool encodeProgram(const CodeWriter& codeWriter, const string& name, const TranslationOptions& options,
+	const ObjectLibrary* library, vector<uint16_t>& rom)
+{
+	// The program's own code is one section that is always linked; it pulls in the library
+	// functions it refers to, and those pull in theirs
+	ObjectSection programCode;
+	const ObjectSection* program = &programCode;
+	if (codeWriter.output().encoding()) {
+		if (!codeWriter.output().encodedValid()) return false;
+		// Linked where it is, unless the outliner is going to rewrite it
+		if (options.outline) programCode = codeWriter.output().encoded();
+		else program = &codeWriter.output().encoded();
+	}
+	else {
+		programCode.file = name;
+		if (!programCode.assemble(codeWriter.output().view())) return false;
+	}
+	if (options.outline) {
+		unique_ptr<Profile> profile;
+		if (!options.profileName.empty()) {
+			profile = make_unique<Profile>(options.profileName);
+			if (profile->didFailOpen()) return false;
+		}
+		Outliner outliner(programCode);
+		int outlined = outliner.run(profile.get());
+		cout << "Outlined " << outlined << " sequences from " << outliner.sitesReplaced() << (profile ? " cold places" : " places outside loops") << ", saving "
+			<< outliner.instructionsSaved() << " instructions (" << 2 * outliner.instructionsSaved() << " bytes). Each run of an outlined sequence takes "
+			<< Outliner::CYCLES_PER_RUN << " more cycles";
+		if (profile) cout << ", " << outliner.cyclesAdded() << " over the profiled run";
+		cout << "." << endl;
+	}
+	Linker linker;
+	linker.add(*program, true);
+	for (auto& entryPoint : entryPoints) linker.require(entryPoint);
+	if (library) {
+		for (auto& section : library->sections()) linker.add(section);
+	}
+	rom = linker.link();
+	if (library) {
+		cout << "Linked " << linker.numLinked() - 1 << " of " << library->sections().size() << " library functions, program is " << rom.size() << " instructions." << endl;
+	}
+	return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "Parser.h"
+#include "CodeWriter.h"
+#include "HackObject.h"
+#include <string>
+#include <vector>
+#include <set>
+#include <iostream>
+
+// OS classes, which are translated before the user's classes of a directory
+extern const std::vector<std::string> osFiles;
+// Functions that are kept even when nothing calls them
+extern const std::set<std::string> entryPoints;
+
+struct TranslationOptions {
+	int jobs = 1;
+	bool cacheTop = false;     // keep the top of the VM stack in D between commands
+	bool deferSP = false;      // write SP back once per basic block rather than on every push and pop (with cacheTop)
+	int sizeBudget = -1;       // largest program in instructions before comparisons are shared, -1 for no limit
+	int inlineSize = 0;        // leaf functions of at most this many commands are inlined
+	bool callStubs = false;    // specialized call and return stubs per frame shape
+	bool staticFrames = false; // fixed frames for functions that cannot be re-entered
+	std::string profileName;   // label counts from an emulator run, hot code is compiled for speed and cold code for size
+	bool useCache = false;     // -cache: reuse functions translated by earlier runs, see CodeWriter::setCache
+	bool outline = false;      // move repeated instruction sequences of a .hack build into subroutines
+	std::string rulesName;     // peephole rules from the superoptimizer, applied to the translated code
+	std::string reportName;    // JSON file for the size and static cost of each function, see CostReport
+
+	TranslationOptions();
+	// Reads the option at argv[i] and any value after it, false if it is not a translator option
+	bool parse(int& i, int argc, char* argv[]);
+};
+
+// Runs the whole-program passes on a loaded program and writes it with codeWriter. A
+// directory is a whole program with a bootstrap; a single file is translated as it is.
+// Functions the program does not define may come from a library it is linked with.
+bool translateProgram(VMProgram& program, bool isDirectory, const TranslationOptions& options, CodeWriter& codeWriter,
+	const ObjectLibrary* library = nullptr);
+
+// Translates VM code as it arrives, one function at a time, and writes each function's assembly
+// as soon as the next one starts, so memory stays bounded by the largest function. The stream is
+// a whole program and gets the bootstrap. Functions are named Class.name as the compiler writes
+// them, and statics are kept per class. Settings that need the whole program do not apply, and
+// nothing is removed as dead code.
+bool translateStream(std::istream& in, std::ostream& out, const TranslationOptions& options);
+
+// Whether a .hack build can encode while translating (CodeWriter::setDirectEncoding). -rules and
+// -report work on the assembly text, so with them the text is kept and encoded afterwards.
+bool encodesDirectly(const TranslationOptions& options);
+
+// Links the translated program into ROM words. Labels are recorded as fixups while encoding and
+// patched once the layout is known. A directly encoding codeWriter already holds the words;
+// otherwise its assembly is encoded here, in memory. With a library, the library functions the
+// program refers to are linked in after it.
+bool encodeProgram(const CodeWriter& codeWriter, const std::string& name, const TranslationOptions& options,
+	const ObjectLibrary* library, std::vector<uint16_t>& rom);
+
+// Translates every function on its own into a library section, for linking with programs later.
+// Only settings that stay within one function apply.
+bool buildLibrary(VMProgram& program, const TranslationOptions& options, ObjectLibrary& library);
@@ -1,2 +1,2 @@
 #!/bin/bash
-g++ -std=c++2a -g *.cpp -o VMTranslator.o
+g++ -std=c++2a -g *.cpp -pthread -o VMTranslator.o